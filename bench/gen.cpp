@@ -0,0 +1,240 @@
+/// Generator and compiler cost of every output mode.
+///
+/// For each mode ircc generates sources of LISTFILE into a temporary
+/// directory, then every generated file is compiled to an object, the way
+/// a build would compile shards. Commands run as child processes, wall time
+/// is measured around them and peak RSS is taken from wait4. Prints a json
+/// line per mode with the median of the repeats.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+struct Mode
+{
+    std::string name;
+    std::vector<std::string> options;
+    std::string extension;
+};
+
+struct Run
+{
+    double seconds = 0;
+    double cpu_seconds = 0;
+    long rss_kb = 0;
+};
+
+struct Sample
+{
+    Run generator;
+    Run compiler;
+    uint64_t source_bytes = 0;
+    size_t files = 0;
+};
+
+/// Runs command in dir, returns false if it did not exit with 0
+bool run(const std::vector<std::string> &command,
+         const std::string &dir,
+         Run &result)
+{
+    std::vector<char *> argv;
+    for (auto &arg : command)
+        argv.push_back((char *)arg.c_str());
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0)
+    {
+        if (chdir(dir.c_str()) != 0)
+            _exit(127);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0)
+        return false;
+    auto finish = std::chrono::steady_clock::now();
+
+    result.seconds += std::chrono::duration<double>(finish - start).count();
+    result.cpu_seconds += usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                          (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) /
+                              1e6;
+    result.rss_kb = std::max(result.rss_kb, usage.ru_maxrss);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool measure(const std::string &ircc,
+             const std::string &compiler,
+             const std::filesystem::path &listfile,
+             const Mode &mode,
+             const std::filesystem::path &out,
+             Sample &sample)
+{
+    std::filesystem::remove_all(out);
+    std::filesystem::create_directories(out);
+
+    std::vector<std::string> command = {
+        ircc, listfile.filename(), "-o",
+        (out / ("resources.gen." + mode.extension)).string()};
+    command.insert(command.end(), mode.options.begin(), mode.options.end());
+    if (!run(command, listfile.parent_path(), sample.generator))
+    {
+        std::cerr << "Failed: " << ircc << " (" << mode.name << ")\n";
+        return false;
+    }
+
+    std::vector<std::filesystem::path> sources;
+    for (auto &entry : std::filesystem::directory_iterator(out))
+        if (entry.path().extension() == "." + mode.extension)
+            sources.push_back(entry.path());
+    std::sort(sources.begin(), sources.end());
+
+    for (auto &source : sources)
+    {
+        sample.source_bytes += std::filesystem::file_size(source);
+        sample.files++;
+        std::string object = source.string() + ".o";
+        if (!run({compiler, "-O2", "-c", source.string(), "-o", object},
+                 out.string(),
+                 sample.compiler))
+        {
+            std::cerr << "Failed: " << compiler << " " << source << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+void print_help()
+{
+    std::cout << "Usage: bench_gen [options] LISTFILE\n";
+    std::cout << "Options:\n";
+    std::cout << "\t-h\t\tShow this help\n";
+    std::cout << "\t-i IRCC\t\tgenerator (default " IRCC_BENCH_IRCC ")\n";
+    std::cout << "\t-x CXX\t\tC++ compiler (default " IRCC_BENCH_CXX ")\n";
+    std::cout << "\t-c CC\t\tC compiler (default " IRCC_BENCH_CC ")\n";
+    std::cout << "\t-m MODE\t\tsource, incbin, shards or c_only, may be "
+                 "repeated (default all)\n";
+    std::cout << "\t-r N\t\trepeats (default 3)\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string ircc = IRCC_BENCH_IRCC;
+    std::string cxx = IRCC_BENCH_CXX;
+    std::string cc = IRCC_BENCH_CC;
+    std::vector<std::string> selected;
+    int repeats = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hi:x:c:m:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            ircc = optarg;
+            break;
+        case 'x':
+            cxx = optarg;
+            break;
+        case 'c':
+            cc = optarg;
+            break;
+        case 'm':
+            selected.push_back(optarg);
+            break;
+        case 'r':
+            repeats = std::max(1, atoi(optarg));
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+        default:
+            print_help();
+            exit(-1);
+        }
+    }
+    if (optind != argc - 1)
+    {
+        print_help();
+        exit(-1);
+    }
+    auto listfile = std::filesystem::absolute(argv[optind]);
+    ircc = std::filesystem::absolute(ircc);
+
+    const std::vector<Mode> modes = {
+        {"source", {}, "cpp"},
+        {"incbin", {"--incbin"}, "cpp"},
+        {"shards", {"--shards", "4"}, "cpp"},
+        {"c_only", {"--c_only"}, "c"},
+    };
+
+    auto temp = std::filesystem::temp_directory_path() /
+                ("ircc_bench_gen." + std::to_string(getpid()));
+    int failures = 0;
+    for (auto &mode : modes)
+    {
+        if (!selected.empty() && std::find(selected.begin(),
+                                           selected.end(),
+                                           mode.name) == selected.end())
+            continue;
+
+        std::vector<double> generator_s, compile_s, compile_cpu_s;
+        Sample last;
+        long generator_rss_kb = 0;
+        long compile_rss_kb = 0;
+        bool ok = true;
+        for (int i = 0; i < repeats && ok; ++i)
+        {
+            Sample sample;
+            ok = measure(ircc,
+                         mode.extension == "c" ? cc : cxx,
+                         listfile,
+                         mode,
+                         temp / mode.name,
+                         sample);
+            generator_s.push_back(sample.generator.seconds);
+            compile_s.push_back(sample.compiler.seconds);
+            compile_cpu_s.push_back(sample.compiler.cpu_seconds);
+            generator_rss_kb =
+                std::max(generator_rss_kb, sample.generator.rss_kb);
+            compile_rss_kb = std::max(compile_rss_kb, sample.compiler.rss_kb);
+            last = sample;
+        }
+        if (!ok)
+        {
+            failures++;
+            continue;
+        }
+
+        std::cout << "{\"bench\": \"gen\", \"mode\": \"" << mode.name
+                  << "\", \"generator_s\": " << median(generator_s)
+                  << ", \"generator_rss_kb\": " << generator_rss_kb
+                  << ", \"source_bytes\": " << last.source_bytes
+                  << ", \"files\": " << last.files
+                  << ", \"compile_s\": " << median(compile_s)
+                  << ", \"compile_cpu_s\": " << median(compile_cpu_s)
+                  << ", \"compile_rss_kb\": " << compile_rss_kb << "}"
+                  << std::endl;
+    }
+    std::filesystem::remove_all(temp);
+    return failures > 0 ? 1 : 0;
+}
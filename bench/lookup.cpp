@@ -0,0 +1,169 @@
+/// Lookup benchmark of the generated accessors.
+///
+/// Is linked with a synthetic set of path-like keys (synth set). Queries are
+/// shuffled mixes of present keys and of missing keys which share their
+/// prefixes, with several hit ratios. Every measurement is printed as a json
+/// line, so results of releases can be compared.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <ircc/ircc.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+struct Options
+{
+    size_t queries = 1000000;
+    int repeats = 5;
+    std::vector<double> hit_ratios = {1.0, 0.9, 0.5, 0.0};
+};
+
+/// Missing key close to a present one: other extension, other last
+/// character or other top directory
+std::string make_miss(const std::string &key, size_t variant)
+{
+    switch (variant % 3)
+    {
+    case 0:
+        return key + ".map";
+    case 1:
+    {
+        std::string miss = key;
+        miss.back() = miss.back() == 'x' ? 'y' : 'x';
+        return miss;
+    }
+    default:
+        return "/cdn" + key;
+    }
+}
+
+std::vector<std::string> make_queries(const std::vector<std::string> &keys,
+                                      double hit_ratio,
+                                      size_t count,
+                                      std::mt19937_64 &random)
+{
+    std::vector<std::string> queries;
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    std::bernoulli_distribution hit(hit_ratio);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto &key = keys[pick(random)];
+        queries.push_back(hit(random) ? key : make_miss(key, i));
+    }
+    return queries;
+}
+
+/// Median time of one call of `func(query)` in ns
+template <class Func>
+double measure(const std::vector<std::string> &queries,
+               int repeats,
+               Func &&func)
+{
+    std::vector<double> samples;
+    for (int r = 0; r < repeats; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (auto &query : queries)
+            func(query);
+        auto finish = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::nano> elapsed = finish - start;
+        samples.push_back(elapsed.count() / queries.size());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+void print_result(size_t keys,
+                  const std::string &accessor,
+                  double hit_ratio,
+                  size_t queries,
+                  double ns)
+{
+    std::cout << "{\"bench\": \"lookup\", \"keys\": " << keys
+              << ", \"accessor\": \"" << accessor << "\"";
+    if (hit_ratio >= 0)
+        std::cout << ", \"hit_ratio\": " << hit_ratio;
+    std::cout << ", \"queries\": " << queries << ", \"ns_per_op\": " << ns
+              << ", \"ops_per_s\": " << 1e9 / ns << "}" << std::endl;
+}
+
+void print_help()
+{
+    std::cout << "Usage: bench_lookup_N [options]\n";
+    std::cout << "Options:\n";
+    std::cout << "\t-h\t\tShow this help\n";
+    std::cout << "\t-q N\t\tqueries per measurement (default 1000000)\n";
+    std::cout << "\t-r N\t\trepeats, the median is reported (default 5)\n";
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "hq:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'q':
+            opts.queries = std::max(1L, atol(optarg));
+            break;
+        case 'r':
+            opts.repeats = std::max(1, atoi(optarg));
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+        default:
+            print_help();
+            exit(-1);
+        }
+    }
+
+    auto keys = ircc_keys();
+    if (keys.empty())
+    {
+        std::cout << "No resources" << std::endl;
+        return 1;
+    }
+
+    volatile size_t sink = 0;
+    std::mt19937_64 random(42);
+    for (double hit_ratio : opts.hit_ratios)
+    {
+        auto queries = make_queries(keys, hit_ratio, opts.queries, random);
+        double ns = measure(queries,
+                            opts.repeats,
+                            [&](const std::string &query)
+                            {
+                                size_t size = 0;
+                                ircc_c_string(query.c_str(), &size);
+                                sink = sink + size;
+                            });
+        print_result(keys.size(), "ircc_c_string", hit_ratio, opts.queries, ns);
+
+        ns = measure(queries,
+                     opts.repeats,
+                     [&](const std::string &query)
+                     { sink = sink + ircc_pair(query).second; });
+        print_result(keys.size(), "ircc_pair", hit_ratio, opts.queries, ns);
+
+        ns = measure(queries,
+                     opts.repeats,
+                     [&](const std::string &query)
+                     { sink = sink + ircc_string(query).size(); });
+        print_result(keys.size(), "ircc_string", hit_ratio, opts.queries, ns);
+    }
+
+    // the whole key list per call
+    std::vector<std::string> calls(std::max<size_t>(1, 1000000 / keys.size()));
+    double ns = measure(calls,
+                        opts.repeats,
+                        [&](const std::string &)
+                        { sink = sink + ircc_keys().size(); });
+    print_result(keys.size(), "ircc_keys", -1, calls.size(), ns);
+    return 0;
+}
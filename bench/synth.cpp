@@ -0,0 +1,177 @@
+/// Writes synthetic resource sets for the benchmarks. Every set is a
+/// directory with resources.txt and the files it lists:
+///
+///   synth blob DIR MEGABYTES    one pseudo-random payload, key /blob
+///   synth set DIR COUNT         COUNT path-like keys of small payloads,
+///                               which share a few source files
+///   synth tree DIR FILES MEGABYTES
+///                               FILES small text and binary files of up
+///                               to 16 KB, and two huge files, text and
+///                               binary, of MEGABYTES in total
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+/// xorshift64*, the same sequence on every host
+struct Random
+{
+    uint64_t state;
+
+    uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+};
+
+void write_blob(const std::string &dir, size_t megabytes)
+{
+    Random random{1};
+    std::ofstream out(dir + "/blob.bin", std::ios::binary);
+    std::vector<uint64_t> chunk(1 << 17);
+    for (size_t mb = 0; mb < megabytes; ++mb)
+    {
+        for (auto &word : chunk)
+            word = random.next();
+        out.write((const char *)chunk.data(), chunk.size() * sizeof(uint64_t));
+    }
+    std::ofstream(dir + "/resources.txt") << "/blob ./blob.bin\n";
+}
+
+/// Key like /static/js/vendor/chart-3f9a2c1b.js, depth 1 to 3
+std::string make_key(Random &random)
+{
+    static const std::vector<std::string> top = {
+        "static", "assets", "api", "docs", "img", "fonts", "locales", "app"};
+    static const std::vector<std::string> middle = {
+        "js", "css", "icons", "v1", "v2", "en", "de", "components", "vendor",
+        "pages", "thumbnails", "shared"};
+    static const std::vector<std::string> names = {
+        "index", "main", "chart", "button", "layout", "user", "logo",
+        "search", "table", "modal", "router", "theme", "settings", "help"};
+    static const std::vector<std::string> extensions = {
+        ".js", ".css", ".png", ".svg", ".json", ".html", ".woff2"};
+
+    std::string key = "/" + top[random.next() % top.size()];
+    for (size_t depth = random.next() % 3; depth > 0; --depth)
+        key += "/" + middle[random.next() % middle.size()];
+    char hash[16];
+    snprintf(hash, sizeof(hash), "%08x", (unsigned)random.next());
+    return key + "/" + names[random.next() % names.size()] + "-" + hash +
+           extensions[random.next() % extensions.size()];
+}
+
+void write_set(const std::string &dir, size_t count)
+{
+    Random random{2};
+    std::filesystem::create_directories(dir + "/pool");
+    const std::vector<size_t> sizes = {8, 16, 32, 64};
+    for (size_t size : sizes)
+    {
+        std::string payload;
+        while (payload.size() < size)
+            payload += (char)('a' + random.next() % 26);
+        std::ofstream(dir + "/pool/" + std::to_string(size) + ".txt")
+            << payload;
+    }
+
+    std::set<std::string> keys;
+    while (keys.size() < count)
+        keys.insert(make_key(random));
+    std::ofstream out(dir + "/resources.txt");
+    for (auto &key : keys)
+        out << key << " ./pool/" << sizes[random.next() % sizes.size()]
+            << ".txt\n";
+}
+
+/// Text of lines of words, compresses like markup or sources
+std::string make_text(Random &random, size_t size)
+{
+    static const std::vector<std::string> words = {
+        "<div", "class=", "\"item\"", "return", "function", "const", "{",
+        "}", "color:", "#fff;", "margin:", "0", "width", "height", "the",
+        "resource", "value", "=", ";", "</div>"};
+    std::string text;
+    text.reserve(size + 16);
+    while (text.size() < size)
+    {
+        text += words[random.next() % words.size()];
+        text += random.next() % 8 == 0 ? '\n' : ' ';
+    }
+    text.resize(size);
+    return text;
+}
+
+std::string make_binary(Random &random, size_t size)
+{
+    std::string binary(size, '\0');
+    for (auto &byte : binary)
+        byte = (char)random.next();
+    return binary;
+}
+
+void write_tree(const std::string &dir, size_t files, size_t megabytes)
+{
+    Random random{3};
+    std::ofstream out(dir + "/resources.txt");
+    for (size_t i = 0; i < files; ++i)
+    {
+        std::string sub = "d" + std::to_string(i % 32);
+        std::filesystem::create_directories(dir + "/files/" + sub);
+        size_t size = 1 + random.next() % 16384;
+        bool text = i % 2 == 0;
+        std::string name = sub + "/f" + std::to_string(i) +
+                           (text ? ".txt" : ".bin");
+        std::ofstream(dir + "/files/" + name, std::ios::binary)
+            << (text ? make_text(random, size) : make_binary(random, size));
+        out << "/" << name << " ./files/" << name << "\n";
+    }
+
+    size_t half = megabytes * 1024 * 1024 / 2;
+    std::ofstream(dir + "/huge.txt", std::ios::binary)
+        << make_text(random, half);
+    std::ofstream(dir + "/huge.bin", std::ios::binary)
+        << make_binary(random, half);
+    out << "/huge.txt ./huge.txt\n";
+    out << "/huge.bin ./huge.bin\n";
+}
+
+void print_help()
+{
+    std::cout << "Usage: synth blob DIR MEGABYTES\n";
+    std::cout << "       synth set DIR COUNT\n";
+    std::cout << "       synth tree DIR FILES MEGABYTES\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        print_help();
+        return -1;
+    }
+    std::string mode = argv[1];
+    std::string dir = argv[2];
+    std::filesystem::create_directories(dir);
+
+    if (mode == "blob" && argc == 4)
+        write_blob(dir, std::stoul(argv[3]));
+    else if (mode == "set" && argc == 4)
+        write_set(dir, std::stoul(argv[3]));
+    else if (mode == "tree" && argc == 5)
+        write_tree(dir, std::stoul(argv[3]), std::stoul(argv[4]));
+    else
+    {
+        print_help();
+        return -1;
+    }
+    return 0;
+}
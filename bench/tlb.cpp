@@ -0,0 +1,134 @@
+/// Data TLB benchmark of payloads in the huge page section.
+///
+/// Reads random cache lines of the /blob payload, which is generated with
+/// --huge-threshold, and counts data TLB misses with perf_event_open: first
+/// from the original mapping of the binary, then after ircc_huge_remap()
+/// moved it to transparent huge pages. Prints the result as json. Misses are
+/// null where perf events are not available.
+///
+/// bench_tlb_base is built without --huge-threshold, for comparison; it has
+/// no ircc_huge_remap.
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <ircc/ircc.h>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#pragma weak ircc_huge_remap
+
+struct Sample
+{
+    double ns_per_read;
+    long long dtlb_misses; // < -1 if not counted
+};
+
+int open_dtlb_counter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+Sample measure(const char *data, size_t size, size_t reads, int counter)
+{
+    uint64_t state = 88172645463325252ULL;
+    uint64_t lines = size / 64;
+    uint64_t sum = 0;
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        // the next address depends on the read, so misses are not overlapped
+        unsigned char byte = data[(state % lines) * 64];
+        state += byte;
+        sum += byte;
+    }
+    auto finish = std::chrono::steady_clock::now();
+    long long misses = -1;
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+            misses = -1;
+    }
+
+    volatile uint64_t sink = sum;
+    (void)sink;
+    std::chrono::duration<double, std::nano> elapsed = finish - start;
+    return Sample{elapsed.count() / reads, misses};
+}
+
+/// Field of /proc/self/smaps_rollup in KB, such as AnonHugePages
+long smaps_kb(const std::string &field)
+{
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(smaps, line))
+        if (line.rfind(field + ":", 0) == 0)
+            return std::stol(line.substr(field.size() + 1));
+    return -1;
+}
+
+std::string json_sample(const Sample &sample)
+{
+    return "{\"ns_per_read\": " + std::to_string(sample.ns_per_read) +
+           ", \"dtlb_misses\": " +
+           (sample.dtlb_misses < 0 ? std::string("null")
+                                   : std::to_string(sample.dtlb_misses)) +
+           "}";
+}
+
+int main(int argc, char **argv)
+{
+    size_t reads = argc > 1 ? std::stoul(argv[1]) : 20000000;
+    auto [data, size] = ircc_pair("/blob");
+    if (data == nullptr || size < 64)
+    {
+        std::cout << "No /blob resource" << std::endl;
+        return 1;
+    }
+
+    // page faults are not measured
+    uint64_t sum = 0;
+    for (size_t offset = 0; offset < size; offset += 4096)
+        sum += (unsigned char)data[offset];
+    volatile uint64_t sink = sum;
+    (void)sink;
+
+    // recent kernels may map the binary with huge pages already
+    long file_pmd_kb = smaps_kb("FilePmdMapped");
+    int counter = open_dtlb_counter();
+    Sample before = measure(data, size, reads, counter);
+    long remapped = ircc_huge_remap ? ircc_huge_remap() : 0;
+    measure(data, size, reads / 10, -1);
+    Sample after = measure(data, size, reads, counter);
+
+    std::cout << "{\"size\": " << size << ", \"reads\": " << reads
+              << ", \"remapped\": " << remapped
+              << ", \"file_pmd_kb\": " << file_pmd_kb
+              << ", \"anon_huge_kb\": " << smaps_kb("AnonHugePages")
+              << ", \"before\": " << json_sample(before)
+              << ", \"after\": " << json_sample(after) << "}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,101 @@
+# CMake integration of ircc.
+#
+#   find_package(ircc REQUIRED)
+#   ircc_add_resources(<target> LISTFILE <resources.txt>
+#                      [MODE source|incbin]
+#                      [SHARDS <n>]
+#                      [C_ONLY]
+#                      [OUTPUT_NAME <name>]
+#                      [WORKING_DIRECTORY <dir>]
+#                      [DEPENDS <files>...]
+#                      [OPTIONS <ircc options>...])
+#
+# Generates resources of LISTFILE and adds generated sources to <target>.
+# Payloads are split to SHARDS files (4 by default), which are compiled in
+# parallel. Shards are rewritten only when their content changes, so editing
+# one resource recompiles one shard. The depfile written by ircc makes
+# changes of the listfile, of sources and of scanned directories rerun the
+# generation.
+#
+# MODE source embeds payloads as string literals. MODE incbin includes them
+# with assembler .incbin directive, generated sources stay small and
+# compilation does not depend on resource size (GNU assembler is needed).
+#
+# WORKING_DIRECTORY is the directory against which paths of LISTFILE are
+# resolved, directory of LISTFILE by default. OPTIONS are passed to ircc
+# as is, for example --vfs or --interpose. DEPENDS lists files which are
+# generated by the build and must exist before ircc runs, such as a
+# generated LISTFILE.
+
+find_program(IRCC_EXECUTABLE ircc
+    HINTS ${CMAKE_CURRENT_LIST_DIR}/../../../bin)
+
+function(ircc_add_resources target)
+    cmake_parse_arguments(IRCC
+        "C_ONLY"
+        "LISTFILE;MODE;SHARDS;OUTPUT_NAME;WORKING_DIRECTORY"
+        "OPTIONS;DEPENDS"
+        ${ARGN})
+
+    if(IRCC_UNPARSED_ARGUMENTS)
+        message(FATAL_ERROR
+            "ircc_add_resources: unknown arguments ${IRCC_UNPARSED_ARGUMENTS}")
+    endif()
+    if(NOT IRCC_LISTFILE)
+        message(FATAL_ERROR "ircc_add_resources: LISTFILE is needed")
+    endif()
+    if(NOT IRCC_EXECUTABLE)
+        message(FATAL_ERROR "ircc_add_resources: ircc executable not found")
+    endif()
+
+    get_filename_component(listfile ${IRCC_LISTFILE} ABSOLUTE
+        BASE_DIR ${CMAKE_CURRENT_SOURCE_DIR})
+    if(NOT IRCC_WORKING_DIRECTORY)
+        get_filename_component(IRCC_WORKING_DIRECTORY ${listfile} DIRECTORY)
+    endif()
+    if(NOT IRCC_OUTPUT_NAME)
+        set(IRCC_OUTPUT_NAME ${target}_resources)
+    endif()
+    if(NOT DEFINED IRCC_SHARDS)
+        set(IRCC_SHARDS 4)
+    endif()
+    if(NOT IRCC_MODE)
+        set(IRCC_MODE source)
+    endif()
+
+    set(options ${IRCC_OPTIONS})
+    if(IRCC_MODE STREQUAL "incbin")
+        list(APPEND options --incbin)
+    elseif(NOT IRCC_MODE STREQUAL "source")
+        message(FATAL_ERROR
+            "ircc_add_resources: MODE must be source or incbin")
+    endif()
+    if(IRCC_C_ONLY)
+        list(APPEND options --c_only)
+        set(extension c)
+    else()
+        set(extension cpp)
+    endif()
+
+    set(base ${CMAKE_CURRENT_BINARY_DIR}/${IRCC_OUTPUT_NAME}.gen)
+    set(shards)
+    if(IRCC_SHARDS GREATER 1)
+        list(APPEND options --shards ${IRCC_SHARDS})
+        math(EXPR last "${IRCC_SHARDS} - 1")
+        foreach(shard RANGE ${last})
+            list(APPEND shards ${base}.shard${shard}.${extension})
+        endforeach()
+    endif()
+
+    add_custom_command(OUTPUT ${base}.${extension}
+        BYPRODUCTS ${shards}
+        COMMAND ${IRCC_EXECUTABLE} ${listfile} -o ${base}.${extension}
+                --depfile ${base}.d ${options}
+        DEPFILE ${base}.d
+        DEPENDS ${IRCC_DEPENDS}
+        WORKING_DIRECTORY ${IRCC_WORKING_DIRECTORY}
+        COMMENT "Generating resources of ${target}"
+        VERBATIM
+    )
+    target_sources(${target} PRIVATE ${base}.${extension} ${shards})
+endfunction()
@@ -0,0 +1,323 @@
+/// Loopback HTTP load generator for the example server.
+///
+/// Every connection is served by its own thread in a closed loop: send a
+/// request, read the whole response, record the latency, repeat. At the end
+/// the per-thread samples are merged and req/s, latency percentiles and
+/// bytes/s are reported.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct Target
+{
+    std::string path;
+    double weight;
+};
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 8;
+    double duration = 10;
+    double warmup = 1;
+    bool keepalive = true;
+    bool json = false;
+    std::vector<Target> targets;
+};
+
+struct WorkerResult
+{
+    std::vector<uint32_t> latencies_us;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+};
+
+std::atomic<bool> measuring(false);
+std::atomic<bool> stopping(false);
+
+int connect_to(const Options &opts)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    addr.sin_addr.s_addr = inet_addr(opts.host.c_str());
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_all(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n =
+            send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+/// Reads one response with a Content-Length body. Bytes past the end of the
+/// response stay in `buffer` for the next call. Returns the body size or -1.
+long read_response(int fd, std::string &buffer)
+{
+    char chunk[16384];
+    size_t header_end;
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return -1;
+        buffer.append(chunk, n);
+    }
+
+    size_t length_pos = buffer.find("Content-Length:");
+    if (length_pos == std::string::npos || length_pos > header_end)
+        return -1;
+    size_t content_length =
+        strtoul(buffer.c_str() + length_pos + strlen("Content-Length:"),
+                nullptr,
+                10);
+
+    size_t total = header_end + 4 + content_length;
+    while (buffer.size() < total)
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return -1;
+        buffer.append(chunk, n);
+    }
+    buffer.erase(0, total);
+    return content_length;
+}
+
+void worker_fn(const Options &opts, unsigned seed, WorkerResult &result)
+{
+    std::mt19937 rng(seed);
+    std::vector<double> weights;
+    for (auto &target : opts.targets)
+        weights.push_back(target.weight);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+    std::vector<std::string> requests;
+    for (auto &target : opts.targets)
+    {
+        std::string request = "GET " + target.path + " HTTP/1.1\r\n";
+        request += "Host: " + opts.host + "\r\n";
+        if (!opts.keepalive)
+            request += "Connection: close\r\n";
+        request += "\r\n";
+        requests.push_back(request);
+    }
+
+    int fd = -1;
+    std::string buffer;
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (fd < 0)
+        {
+            fd = connect_to(opts);
+            buffer.clear();
+            if (fd < 0)
+            {
+                if (measuring.load(std::memory_order_relaxed))
+                    result.errors++;
+                // the server is down or out of backlog, do not spin
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+        }
+
+        long size = -1;
+        if (send_all(fd, requests[pick(rng)]))
+            size = read_response(fd, buffer);
+        auto finish = std::chrono::steady_clock::now();
+
+        if (size < 0 || !opts.keepalive)
+        {
+            close(fd);
+            fd = -1;
+        }
+
+        if (!measuring.load(std::memory_order_relaxed))
+            continue;
+        if (size < 0)
+        {
+            result.errors++;
+            continue;
+        }
+        result.bytes += size;
+        result.latencies_us.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(finish -
+                                                                  start)
+                .count());
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+uint32_t percentile(const std::vector<uint32_t> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+void print_help()
+{
+    std::cout << "Usage: loadgen [options]\n";
+    std::cout << "Options:\n";
+    std::cout << "\t-h\t\tShow this help\n";
+    std::cout << "\t-H HOST\t\tserver address (default 127.0.0.1)\n";
+    std::cout << "\t-p PORT\t\tserver port (default 8080)\n";
+    std::cout << "\t-c N\t\tconcurrent connections, one thread each "
+                 "(default 8)\n";
+    std::cout << "\t-d SECONDS\tmeasurement duration (default 10)\n";
+    std::cout << "\t-w SECONDS\twarmup before measurement (default 1)\n";
+    std::cout << "\t-n\t\tnew connection per request (no keep-alive)\n";
+    std::cout << "\t-u PATH[:WEIGHT]\trequested path, may be repeated; "
+                 "paths are picked by weight, so a mix of asset sizes is a "
+                 "mix of paths of those sizes (default /index.html)\n";
+    std::cout << "\t-j\t\tprint the report as json\n";
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "hH:p:c:d:w:nu:j")) != -1)
+    {
+        switch (opt)
+        {
+        case 'H':
+            opts.host = optarg;
+            break;
+        case 'p':
+            opts.port = atoi(optarg);
+            break;
+        case 'c':
+            opts.connections = std::max(1, atoi(optarg));
+            break;
+        case 'd':
+            opts.duration = atof(optarg);
+            break;
+        case 'w':
+            opts.warmup = atof(optarg);
+            break;
+        case 'n':
+            opts.keepalive = false;
+            break;
+        case 'u':
+        {
+            std::string arg = optarg;
+            auto colon = arg.rfind(':');
+            if (colon == std::string::npos)
+                opts.targets.push_back(Target{arg, 1});
+            else
+                opts.targets.push_back(Target{
+                    arg.substr(0, colon), atof(arg.c_str() + colon + 1)});
+            break;
+        }
+        case 'j':
+            opts.json = true;
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+        default:
+            print_help();
+            exit(-1);
+        }
+    }
+    if (opts.targets.empty())
+        opts.targets.push_back(Target{"/index.html", 1});
+
+    std::vector<WorkerResult> results(opts.connections);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < opts.connections; i++)
+        workers.emplace_back(
+            worker_fn, std::cref(opts), i + 1, std::ref(results[i]));
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(opts.warmup));
+    measuring = true;
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(opts.duration));
+    measuring = false;
+    auto finish = std::chrono::steady_clock::now();
+    stopping = true;
+    for (auto &worker : workers)
+        worker.join();
+
+    double elapsed = std::chrono::duration<double>(finish - start).count();
+    std::vector<uint32_t> latencies;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    for (auto &result : results)
+    {
+        latencies.insert(latencies.end(),
+                         result.latencies_us.begin(),
+                         result.latencies_us.end());
+        bytes += result.bytes;
+        errors += result.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    double rps = latencies.size() / elapsed;
+    double bps = bytes / elapsed;
+    uint32_t p50 = percentile(latencies, 0.50);
+    uint32_t p99 = percentile(latencies, 0.99);
+    uint32_t p999 = percentile(latencies, 0.999);
+
+    if (opts.json)
+    {
+        std::cout << "{\"connections\": " << opts.connections
+                  << ", \"keepalive\": " << (opts.keepalive ? "true" : "false")
+                  << ", \"duration_s\": " << elapsed
+                  << ", \"requests\": " << latencies.size()
+                  << ", \"errors\": " << errors << ", \"req_per_s\": " << rps
+                  << ", \"bytes_per_s\": " << bps << ", \"p50_us\": " << p50
+                  << ", \"p99_us\": " << p99 << ", \"p999_us\": " << p999
+                  << "}" << std::endl;
+    }
+    else
+    {
+        std::cout << "connections: " << opts.connections
+                  << (opts.keepalive ? " (keep-alive)" : " (close)") << "\n";
+        std::cout << "requests:    " << latencies.size() << " in " << elapsed
+                  << " s, " << errors << " errors\n";
+        std::cout << "req/s:       " << rps << "\n";
+        std::cout << "bytes/s:     " << bps << "\n";
+        std::cout << "latency us:  p50 " << p50 << "  p99 " << p99
+                  << "  p999 " << p999 << std::endl;
+    }
+    return errors > 0 && latencies.empty() ? 1 : 0;
+}
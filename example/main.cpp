@@ -61,7 +61,7 @@ int make_server(std::string host, int port)
         perror("bind");
         exit(-1);
     }
-    listen(sockfd, 5);
+    listen(sockfd, SOMAXCONN);
     return sockfd;
 }
 
@@ -80,8 +80,10 @@ int read_line(int socket_fd, std::string &line)
 {
     char c;
     int count = 0;
-    while (read(socket_fd, &c, 1) > 0)
+    while (true)
     {
+        if (read(socket_fd, &c, 1) <= 0)
+            return count > 0 ? count : -1;
         if (c == '\n')
         {
             break;
@@ -92,6 +94,8 @@ int read_line(int socket_fd, std::string &line)
     return count;
 }
 
+bool verbose = true;
+
 void client_thread_fn(int client_fd)
 {
     try
@@ -102,9 +106,13 @@ void client_thread_fn(int client_fd)
         while (true)
         {
             std::string line;
-            if (read_line(client_fd, line) > 0)
+            int count = read_line(client_fd, line);
+            if (count < 0)
+                break;
+            if (count > 0)
             {
-                std::cout << "READ: " << line << std::endl;
+                if (verbose)
+                    std::cout << "READ: " << line << std::endl;
 
                 if (line.find("GET") == 0)
                 {
@@ -113,7 +121,9 @@ void client_thread_fn(int client_fd)
                     {
                         resource = "/index.html";
                     }
-                    std::cout << "SEND Resource: " << resource << std::endl;
+                    if (verbose)
+                        std::cout << "SEND Resource: " << resource
+                                  << std::endl;
                     std::string content = ircc_string(resource);
                     std::string content_type = "text/html";
                     std::string response;
@@ -140,6 +150,10 @@ int main(int argc, const char * argv[])
     } else {
         port = 8080;
     }
+    if (argc >= 3 && std::string(argv[2]) == "--quiet") {
+        verbose = false;
+    }
+    signal(SIGPIPE, SIG_IGN);
 
     /// simple http server
     server = make_server("0.0.0.0", port);
@@ -2,6 +2,8 @@
 #define IRCC_H_
 
 #ifdef __cplusplus
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string>
 #include <vector>
@@ -11,10 +13,95 @@ extern std::pair<const char *, size_t> ircc_pair(const std::string &key);
 extern std::vector<std::string> ircc_keys();
 extern "C" const char *ircc_c_string(const char *key, size_t *sizeptr);
 extern "C" const char *ircc_name_by_no(size_t no);
+extern "C" int ircc_fd(const char *key);
 #else
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 extern const char *ircc_c_string(const char *key, size_t *sizeptr);
 const char *ircc_name_by_no(size_t no);
+extern int ircc_fd(const char *key);
+#endif
+
+/* Embedded virtual filesystem, generated with --vfs option */
+#ifdef __cplusplus
+extern "C" {
+#endif
+struct ircc_stat
+{
+    size_t size; //< file size or number of directory entries
+    int is_dir;
+    int ino;
+};
+
+struct ircc_dir
+{
+    int node;
+    int next;
+};
+
+struct ircc_dirent
+{
+    const char *name;
+    int is_dir;
+    int ino;
+};
+
+struct ircc_file
+{
+    const char *data;
+    size_t size;
+    size_t pos;
+};
+
+int ircc_stat(const char *path, struct ircc_stat *st);
+int ircc_opendir(const char *path, struct ircc_dir *dir);
+int ircc_readdir(struct ircc_dir *dir, struct ircc_dirent *ent);
+int ircc_open(const char *path, struct ircc_file *file);
+size_t ircc_read(struct ircc_file *file, void *buf, size_t size);
+long ircc_seek(struct ircc_file *file, long offset, int whence);
+
+/* Page residency and prefetch of payloads, Linux only */
+struct ircc_residency
+{
+    size_t size;     //< of payload
+    size_t pages;    //< touched by payload, partially or entirely
+    size_t resident; //< pages in memory
+};
+
+int ircc_residency(const char *key, struct ircc_residency *res);
+void ircc_residency_report(FILE *file);
+int ircc_cold(const char *key);
+int ircc_drop(const char *key);
+int ircc_prefetch(const char *key);
+int ircc_prefetch_prefix(const char *prefix);
+int ircc_prefetch_warm(void);
+
+/* Remaps payloads placed with --huge-threshold to huge pages, Linux only */
+long ircc_huge_remap(void);
+
+/* Access counters, generated with --counters option */
+struct ircc_resource_stats
+{
+    uint64_t hits;  //< lookups of the resource
+    uint64_t bytes; //< bytes served by the lookups
+};
+
+int ircc_stats_get(size_t no, struct ircc_resource_stats *stats);
+void ircc_stats_dump(FILE *file);
+
+/* External pack runtime, generated with --pack-runtime option */
+struct ircc_pack;
+int ircc_pack_open(const char *path);
+int ircc_pack_open_module(const char *path);
+const struct ircc_pack *ircc_pack_acquire(void);
+void ircc_pack_release(const struct ircc_pack *view);
+const char *ircc_pack_c_string(const struct ircc_pack *view,
+                               const char *key,
+                               size_t *sizeptr);
+void ircc_pack_quiescent(void);
+#ifdef __cplusplus
+}
 #endif
 
 #endif
\ No newline at end of file
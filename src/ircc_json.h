@@ -0,0 +1,230 @@
+#ifndef IRCC_JSON_H_
+#define IRCC_JSON_H_
+
+/* Read-only accessor of JSON resources converted at generation time by the
+   `jsonb` transform stage. Values are read in place: nothing is parsed or
+   allocated at runtime.
+
+   Binary form (little endian on every host, no alignment):
+     header  "IRJB" u32 root
+     value   u8 tag, then by tag:
+             null, false, true  nothing
+             int                i64
+             double             f64
+             string             u32 length, bytes, '\0'
+             array              u32 count, u32 element[count]
+             object             u32 count, {u32 key, u32 value}[count]
+   Offsets are counted from the beginning of the resource, keys point to
+   string values, object entries are sorted by key. */
+
+#include <ircc/ircc.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+class ircc_json
+{
+public:
+    enum type_t
+    {
+        TYPE_MISSING = -1,
+        TYPE_NULL = 0,
+        TYPE_FALSE = 1,
+        TYPE_TRUE = 2,
+        TYPE_INT = 3,
+        TYPE_DOUBLE = 4,
+        TYPE_STRING = 5,
+        TYPE_ARRAY = 6,
+        TYPE_OBJECT = 7,
+    };
+
+    ircc_json() = default;
+
+    /// Root value of binary document, missing if it is not one
+    ircc_json(const char *data, size_t size)
+    {
+        if (size < 9 || memcmp(data, "IRJB", 4) != 0)
+            return;
+        *this = ircc_json(data, size, load<uint32_t>(data + 4));
+    }
+
+    /// Root value of embedded resource
+    static ircc_json resource(const char *key)
+    {
+        size_t size = 0;
+        const char *data = ircc_c_string(key, &size);
+        return data ? ircc_json(data, size) : ircc_json();
+    }
+
+    type_t type() const
+    {
+        return _data ? (type_t)_data[_offset] : TYPE_MISSING;
+    }
+
+    explicit operator bool() const
+    {
+        return _data != nullptr;
+    }
+
+    bool is_null() const
+    {
+        return type() == TYPE_NULL;
+    }
+
+    bool is_number() const
+    {
+        return type() == TYPE_INT || type() == TYPE_DOUBLE;
+    }
+
+    bool as_bool(bool otherwise = false) const
+    {
+        type_t t = type();
+        return t == TYPE_TRUE ? true : t == TYPE_FALSE ? false : otherwise;
+    }
+
+    int64_t as_int(int64_t otherwise = 0) const
+    {
+        if (type() == TYPE_INT)
+            return read<int64_t>(_offset + 1);
+        if (type() == TYPE_DOUBLE)
+            return (int64_t)read<double>(_offset + 1);
+        return otherwise;
+    }
+
+    double as_double(double otherwise = 0) const
+    {
+        if (type() == TYPE_DOUBLE)
+            return read<double>(_offset + 1);
+        if (type() == TYPE_INT)
+            return (double)read<int64_t>(_offset + 1);
+        return otherwise;
+    }
+
+    /// String value, terminated by '\0' in place
+    std::string_view as_string(std::string_view otherwise = {}) const
+    {
+        if (type() != TYPE_STRING)
+            return otherwise;
+        return std::string_view(_data + _offset + 5,
+                                read<uint32_t>(_offset + 1));
+    }
+
+    /// Number of elements of array or entries of object
+    size_t size() const
+    {
+        type_t t = type();
+        if (t != TYPE_ARRAY && t != TYPE_OBJECT)
+            return 0;
+        return read<uint32_t>(_offset + 1);
+    }
+
+    /// Element of array or value of object entry by index
+    ircc_json at(size_t index) const
+    {
+        type_t t = type();
+        if (index >= size())
+            return ircc_json();
+        if (t == TYPE_ARRAY)
+            return child(_offset + 5 + index * 4);
+        return child(_offset + 5 + index * 8 + 4);
+    }
+
+    /// Value of object entry by key, binary search
+    ircc_json operator[](std::string_view key) const
+    {
+        if (type() != TYPE_OBJECT)
+            return ircc_json();
+        size_t low = 0;
+        size_t high = size();
+        while (low < high)
+        {
+            size_t mid = (low + high) / 2;
+            int cmp = key.compare(this->key(mid));
+            if (cmp == 0)
+                return child(_offset + 5 + mid * 8 + 4);
+            if (cmp < 0)
+                high = mid;
+            else
+                low = mid + 1;
+        }
+        return ircc_json();
+    }
+
+    ircc_json operator[](const char *key) const
+    {
+        return key ? (*this)[std::string_view(key)] : ircc_json();
+    }
+
+    /// Key of object entry by index
+    std::string_view key(size_t index) const
+    {
+        if (type() != TYPE_OBJECT || index >= size())
+            return {};
+        return child(_offset + 5 + index * 8).as_string();
+    }
+
+private:
+    const char *_data = nullptr;
+    size_t _size = 0;
+    size_t _offset = 0;
+
+    ircc_json(const char *data, size_t size, size_t offset)
+    {
+        if (offset >= size || (uint8_t)data[offset] > TYPE_OBJECT)
+            return;
+        _data = data;
+        _size = size;
+        _offset = offset;
+        if (_offset + extent() > _size)
+            _data = nullptr;
+    }
+
+    /// Bytes of fixed part of value
+    size_t extent() const
+    {
+        switch (type())
+        {
+        case TYPE_INT:
+        case TYPE_DOUBLE:
+            return 9;
+        case TYPE_STRING:
+            return _offset + 5 <= _size ? 6 + read<uint32_t>(_offset + 1)
+                                        : _size;
+        case TYPE_ARRAY:
+            return _offset + 5 <= _size ? 5 + 4 * read<uint32_t>(_offset + 1)
+                                        : _size;
+        case TYPE_OBJECT:
+            return _offset + 5 <= _size ? 5 + 8 * read<uint32_t>(_offset + 1)
+                                        : _size;
+        default:
+            return 1;
+        }
+    }
+
+    /// Little endian value, unaligned
+    template <class T> static T load(const char *ptr)
+    {
+        T value;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        char bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i)
+            bytes[i] = ptr[sizeof(T) - 1 - i];
+        memcpy(&value, bytes, sizeof(T));
+#else
+        memcpy(&value, ptr, sizeof(T));
+#endif
+        return value;
+    }
+
+    template <class T> T read(size_t offset) const
+    {
+        return load<T>(_data + offset);
+    }
+
+    ircc_json child(size_t slot) const
+    {
+        return ircc_json(_data, _size, read<uint32_t>(slot));
+    }
+};
+
+#endif
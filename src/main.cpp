@@ -1,17 +1,44 @@
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
 #include <filesystem>
+#include <fnmatch.h>
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <spawn.h>
+#include <sstream>
 #include <string>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 struct KeySource
 {
     std::string key;
     std::string source; //< path to source file
+    std::vector<std::string> transforms; //< stages applied to content
+    std::string member = {}; //< path inside archive, if source is an archive
+    uint64_t offset = 0; //< of member data in archive
+    std::shared_ptr<const std::string> data = {}; //< member data, read on scan
+    bool warm = false; //< prefetched at startup
 };
 
 struct KeyText
@@ -24,6 +51,9 @@ struct KeyBytes
 {
     std::string key;
     std::string bytes; // < text in C format ( \xAB\x01\x02... )  
+    size_t size = 0;     // < size of resource in bytes
+    std::string incbin = {}; // < absolute source path, if not embedded
+    uint64_t incbin_offset = 0; // < of payload in incbin file
 };
 
 struct KeyBytesDivided
@@ -32,6 +62,186 @@ struct KeyBytesDivided
     std::string bytes_divided; // < text in C format divided to many strings
 };
 
+/// Spans recorded for --stats and --trace. Stage spans cover a whole step of
+/// generation, resource spans one resource in a stage.
+struct ProfileEvent
+{
+    std::string name;
+    std::string stage;
+    bool resource;
+    uint64_t start_us;
+    uint64_t duration_us;
+    uint64_t bytes;
+    size_t thread;
+};
+
+struct Profiler
+{
+    bool enabled = false;
+    std::chrono::steady_clock::time_point origin =
+        std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::vector<ProfileEvent> events;
+    std::map<std::thread::id, size_t> threads;
+};
+
+Profiler PROFILER;
+
+/// Records span from construction to destruction, if profiling is enabled
+class ProfileSpan
+{
+public:
+    ProfileSpan(const char *stage, std::string name = {}, bool resource = false)
+        : _enabled(PROFILER.enabled), _stage(stage), _resource(resource)
+    {
+        if (!_enabled)
+            return;
+        _name = name.empty() ? stage : std::move(name);
+        _start = std::chrono::steady_clock::now();
+    }
+
+    ~ProfileSpan()
+    {
+        if (!_enabled)
+            return;
+        auto finish = std::chrono::steady_clock::now();
+        auto us = [](auto duration)
+        {
+            return (uint64_t)std::chrono::duration_cast<
+                       std::chrono::microseconds>(duration)
+                .count();
+        };
+        std::lock_guard<std::mutex> lock(PROFILER.mutex);
+        auto thread = PROFILER.threads
+                          .emplace(std::this_thread::get_id(),
+                                   PROFILER.threads.size() + 1)
+                          .first->second;
+        PROFILER.events.push_back(ProfileEvent{_name,
+                                               _stage,
+                                               _resource,
+                                               us(_start - PROFILER.origin),
+                                               us(finish - _start),
+                                               _bytes,
+                                               thread});
+    }
+
+    void add_bytes(uint64_t bytes)
+    {
+        _bytes += bytes;
+    }
+
+private:
+    bool _enabled;
+    const char *_stage;
+    bool _resource;
+    std::string _name;
+    uint64_t _bytes = 0;
+    std::chrono::steady_clock::time_point _start;
+};
+
+/// Prints time, bytes and throughput of every stage in order of appearance.
+/// Time of resource stages is summed over threads.
+void print_stats(std::ostream &out)
+{
+    struct Total
+    {
+        std::string stage;
+        bool resource;
+        size_t count = 0;
+        uint64_t duration_us = 0;
+        uint64_t bytes = 0;
+    };
+    std::vector<Total> totals;
+    for (auto &event : PROFILER.events)
+    {
+        auto it = std::find_if(totals.begin(),
+                               totals.end(),
+                               [&](const Total &total)
+                               { return total.stage == event.stage; });
+        if (it == totals.end())
+            it = totals.insert(totals.end(),
+                               Total{event.stage, event.resource});
+        it->count++;
+        it->duration_us += event.duration_us;
+        it->bytes += event.bytes;
+    }
+    std::stable_sort(totals.begin(),
+                     totals.end(),
+                     [](const Total &a, const Total &b)
+                     { return a.resource < b.resource; });
+
+    char line[128];
+    snprintf(line,
+             sizeof(line),
+             "%-16s %8s %10s %12s %10s\n",
+             "stage",
+             "spans",
+             "ms",
+             "bytes",
+             "MB/s");
+    out << line;
+    for (auto &total : totals)
+    {
+        double ms = total.duration_us / 1000.0;
+        double mbps = total.duration_us
+                          ? (double)total.bytes / total.duration_us
+                          : 0.0;
+        snprintf(line,
+                 sizeof(line),
+                 "%-16s %8zu %10.2f %12llu %10.1f\n",
+                 (total.stage + (total.resource ? " (sum)" : "")).c_str(),
+                 total.count,
+                 ms,
+                 (unsigned long long)total.bytes,
+                 mbps);
+        out << line;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    out << "peak rss: " << usage.ru_maxrss / 1024 << " MB" << std::endl;
+}
+
+std::string json_escape(const std::string &text)
+{
+    std::string escaped;
+    for (unsigned char c : text)
+    {
+        char buf[8];
+        if (c == '"' || c == '\\')
+            escaped += std::string("\\") + (char)c;
+        else if (c < 0x20)
+        {
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            escaped += buf;
+        }
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+/// Writes spans in Chrome trace event format, for chrome://tracing or
+/// Perfetto
+void write_trace(const std::string &path)
+{
+    std::ofstream out(path);
+    out << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < PROFILER.events.size(); ++i)
+    {
+        auto &event = PROFILER.events[i];
+        out << "{\"name\":\"" << json_escape(event.name) << "\",\"cat\":\""
+            << (event.resource ? "resource" : "stage")
+            << "\",\"ph\":\"X\",\"ts\":" << event.start_us
+            << ",\"dur\":" << event.duration_us
+            << ",\"pid\":1,\"tid\":" << event.thread
+            << ",\"args\":{\"stage\":\"" << event.stage
+            << "\",\"bytes\":" << event.bytes << "}}"
+            << (i + 1 < PROFILER.events.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+}
+
 uint8_t HIHALF(uint8_t byte)
 {
     return (byte >> 4) & 0x0F;
@@ -84,22 +294,565 @@ bool is_directory(const std::string &path)
     return std::filesystem::is_directory(path);
 }
 
+/// Glob patterns of directory entry. Patterns with '/' are matched against
+/// path relative to the entry directory, others against file name only.
+struct PathFilter
+{
+    std::vector<std::string> include; // < files only, empty means all
+    std::vector<std::string> exclude; // < files and directories
+};
+
+bool glob_match(const std::string &pattern, const std::string &relative)
+{
+    if (pattern.find('/') != std::string::npos)
+    {
+        auto anchored = pattern[0] == '/' ? pattern.substr(1) : pattern;
+        return fnmatch(anchored.c_str(), relative.c_str(), FNM_PATHNAME) == 0;
+    }
+    auto slash = relative.rfind('/');
+    auto name = slash == std::string::npos ? relative
+                                           : relative.substr(slash + 1);
+    return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+}
+
+bool filter_excludes(const PathFilter *filter, const std::string &relative)
+{
+    if (filter == nullptr)
+        return false;
+    for (auto &pattern : filter->exclude)
+        if (glob_match(pattern, relative))
+            return true;
+    return false;
+}
+
+bool filter_includes(const PathFilter *filter, const std::string &relative)
+{
+    if (filter == nullptr || filter->include.empty())
+        return true;
+    for (auto &pattern : filter->include)
+        if (glob_match(pattern, relative))
+            return true;
+    return false;
+}
+
+#ifdef __linux__
+struct linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/// Directories waiting for a scan worker, relative to root of the scan
+struct ScanQueue
+{
+    std::mutex mutex;
+    std::deque<std::string> directories;
+};
+
+struct ScanResult
+{
+    std::vector<std::string> files;       // < relative to root
+    std::vector<std::string> directories; // < relative to root
+    std::string error;
+};
+
+/// Shared state of one directory scan. Every worker owns a queue: it takes
+/// work from the back of its own queue and steals from the front of others,
+/// so big subtrees spread between workers. Idle workers sleep on `idle`
+/// until a directory is queued or the scan is over.
+struct DirectoryScan
+{
+    int root_fd;
+    const PathFilter *filter;
+    std::vector<ScanQueue> queues;
+    std::atomic<size_t> pending; // < directories queued or in progress
+    std::atomic<size_t> queued;  // < directories queued
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    std::vector<ScanResult> results;
+
+    DirectoryScan(int fd, const PathFilter *filter, size_t workers)
+        : root_fd(fd), filter(filter), queues(workers), pending(0),
+          queued(0), results(workers)
+    {
+    }
+};
+
+/// Wakes idle workers. The empty critical section orders the change of
+/// counters before the wait of a worker which has just checked them.
+void scan_wake(DirectoryScan &scan, bool all)
+{
+    {
+        std::lock_guard<std::mutex> lock(scan.idle_mutex);
+    }
+    if (all)
+        scan.idle.notify_all();
+    else
+        scan.idle.notify_one();
+}
+
+void scan_push(DirectoryScan &scan, size_t worker, std::string directory)
+{
+    scan.pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(scan.queues[worker].mutex);
+        scan.queues[worker].directories.push_back(std::move(directory));
+    }
+    scan.queued.fetch_add(1);
+    scan_wake(scan, false);
+}
+
+/// Marks a popped directory as scanned, the last one ends the scan
+void scan_done(DirectoryScan &scan)
+{
+    if (scan.pending.fetch_sub(1) == 1)
+        scan_wake(scan, true);
+}
+
+bool scan_pop(DirectoryScan &scan, size_t worker, std::string &directory)
+{
+    for (size_t i = 0; i < scan.queues.size(); ++i)
+    {
+        auto &queue = scan.queues[(worker + i) % scan.queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.directories.empty())
+            continue;
+        if (i == 0)
+        {
+            directory = std::move(queue.directories.back());
+            queue.directories.pop_back();
+        }
+        else
+        {
+            directory = std::move(queue.directories.front());
+            queue.directories.pop_front();
+        }
+        scan.queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+/// Reads one directory with getdents64. Type of entry is taken from d_type,
+/// only unknown types and symlinks are resolved with fstatat. Excluded
+/// entries are skipped before that, so excluded subtrees are never opened.
+void scan_directory(DirectoryScan &scan,
+                    size_t worker,
+                    const std::string &directory,
+                    std::vector<char> &buf)
+{
+    auto &result = scan.results[worker];
+    int fd = openat(scan.root_fd,
+                    directory.empty() ? "." : directory.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (result.error.empty())
+            result.error = directory + ": " + strerror(errno);
+        return;
+    }
+    result.directories.push_back(directory);
+    std::string prefix = directory.empty() ? "" : directory + "/";
+
+    long len;
+    while ((len = syscall(SYS_getdents64, fd, buf.data(), buf.size())) > 0)
+    {
+        for (long offset = 0; offset < len;)
+        {
+            auto entry = (struct linux_dirent64 *)(buf.data() + offset);
+            offset += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                continue;
+            std::string relative = prefix + name;
+            if (filter_excludes(scan.filter, relative))
+                continue;
+
+            bool is_dir = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+            {
+                struct stat st;
+                is_dir = fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+            }
+            if (is_dir)
+                scan_push(scan, worker, std::move(relative));
+            else if (filter_includes(scan.filter, relative))
+                result.files.push_back(std::move(relative));
+        }
+    }
+    if (len < 0 && result.error.empty())
+        result.error = directory + ": " + strerror(errno);
+    close(fd);
+}
+
+void scan_worker(DirectoryScan &scan, size_t worker)
+{
+    std::vector<char> buf(1 << 16);
+    std::string directory;
+    while (scan.pending.load() > 0)
+    {
+        if (!scan_pop(scan, worker, directory))
+        {
+            std::unique_lock<std::mutex> lock(scan.idle_mutex);
+            scan.idle.wait(lock,
+                           [&scan]
+                           {
+                               return scan.pending.load() == 0 ||
+                                      scan.queued.load() > 0;
+                           });
+            continue;
+        }
+        scan_directory(scan, worker, directory, buf);
+        scan_done(scan);
+    }
+}
+#endif
+
+/// Calls `func` for every file under `path` passing `filter`, paths are
+/// `path/relative`. If `directories` is given, all scanned directories are
+/// appended to it. On Linux the tree is scanned by several threads, files are
+/// reported in sorted order.
 void for_each_directory_file_recursive(
-    const std::string &path, std::function<void(const std::string &)> func)
+    const std::string &path,
+    const std::function<void(const std::string &)> &func,
+    std::vector<std::string> *directories = nullptr,
+    const PathFilter *filter = nullptr)
+{
+    ProfileSpan span("scan", path);
+#ifdef __linux__
+    auto join = [&path](const std::string &relative)
+    {
+        if (relative.empty())
+            return path;
+        if (path.back() == '/')
+            return path + relative;
+        return path + "/" + relative;
+    };
+
+    int root_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+        throw std::filesystem::filesystem_error(
+            "directory scan",
+            path,
+            std::error_code(errno, std::system_category()));
+
+    size_t workers = std::clamp(std::thread::hardware_concurrency(), 1u, 16u);
+    DirectoryScan scan(root_fd, filter, workers);
+    {
+        // the root is read before threads start, so a flat directory starts
+        // none and a few subdirectories no more than there are of them
+        std::vector<char> buf(1 << 16);
+        std::string root;
+        scan_push(scan, 0, "");
+        scan_pop(scan, 0, root);
+        scan_directory(scan, 0, root, buf);
+        scan_done(scan);
+    }
+    std::vector<std::thread> threads;
+    size_t helpers = std::min(workers - 1, scan.queued.load());
+    for (size_t i = 1; i <= helpers; ++i)
+        threads.emplace_back(scan_worker, std::ref(scan), i);
+    scan_worker(scan, 0);
+    for (auto &thread : threads)
+        thread.join();
+    close(root_fd);
+
+    std::vector<std::string> files;
+    std::vector<std::string> scanned;
+    for (auto &result : scan.results)
+    {
+        if (!result.error.empty())
+            throw std::filesystem::filesystem_error(
+                result.error,
+                path,
+                std::make_error_code(std::errc::io_error));
+        files.insert(files.end(), result.files.begin(), result.files.end());
+        scanned.insert(scanned.end(),
+                       result.directories.begin(),
+                       result.directories.end());
+    }
+    std::sort(files.begin(), files.end());
+    std::sort(scanned.begin(), scanned.end());
+
+    if (directories)
+        for (auto &directory : scanned)
+            directories->push_back(join(directory));
+    for (auto &file : files)
+        func(join(file));
+#else
+    if (directories)
+        directories->push_back(path);
+    auto options = std::filesystem::directory_options::follow_directory_symlink;
+    auto it = std::filesystem::recursive_directory_iterator(path, options);
+    for (; it != std::filesystem::recursive_directory_iterator(); ++it)
+    {
+        auto relative = it->path().lexically_relative(path).generic_string();
+        bool is_dir = it->is_directory();
+        if (filter_excludes(filter, relative))
+        {
+            if (is_dir)
+                it.disable_recursion_pending();
+            continue;
+        }
+        if (is_dir)
+        {
+            if (directories)
+                directories->push_back(it->path().string());
+        }
+        else if (filter_includes(filter, relative))
+            func(it->path().string());
+    }
+#endif
+}
+
+bool is_archive(const std::string &path)
+{
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".tar") == 0 &&
+           std::filesystem::is_regular_file(path);
+}
+
+/// Parses numeric field of tar header: octal or GNU base-256
+uint64_t tar_number(const char *field, size_t size)
+{
+    uint64_t value = 0;
+    if ((unsigned char)field[0] & 0x80)
+    {
+        for (size_t i = 1; i < size; ++i)
+            value = (value << 8) | (unsigned char)field[i];
+        return value;
+    }
+    for (size_t i = 0; i < size && field[i]; ++i)
+        if (field[i] >= '0' && field[i] <= '7')
+            value = value * 8 + (field[i] - '0');
+    return value;
+}
+
+/// Parses decimal number of pax header or option, digits only
+bool parse_decimal(const std::string &text, uint64_t &value)
+{
+    char *end = nullptr;
+    if (text.empty() || text[0] < '0' || text[0] > '9')
+        return false;
+    errno = 0;
+    value = strtoull(text.c_str(), &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+/// Checks framing of pax extended header records ("LENGTH key=value\n")
+bool pax_valid(const std::string &records)
+{
+    size_t pos = 0;
+    while (pos < records.size())
+    {
+        size_t space = records.find(' ', pos);
+        uint64_t length;
+        if (space == std::string::npos ||
+            !parse_decimal(records.substr(pos, space - pos), length) ||
+            length <= space - pos + 1 || length > records.size() - pos ||
+            records[pos + length - 1] != '\n')
+            return false;
+        pos += length;
+    }
+    return true;
+}
+
+/// Reads value of `key` from pax extended header records checked by
+/// pax_valid
+bool pax_value(const std::string &records,
+               const std::string &key,
+               std::string &value)
+{
+    size_t pos = 0;
+    while (pos < records.size())
+    {
+        size_t space = records.find(' ', pos);
+        uint64_t length = 0;
+        parse_decimal(records.substr(pos, space - pos), length);
+        auto record = records.substr(space + 1, pos + length - space - 2);
+        if (record.compare(0, key.size() + 1, key + "=") == 0)
+        {
+            value = record.substr(key.size() + 1);
+            return true;
+        }
+        pos += length;
+    }
+    return false;
+}
+
+/// Reads regular files of tar archive (ustar, GNU long names, pax headers)
+/// in one sequential pass. `func` gets member path, offset of its data in
+/// the archive and the data. Excluded members are skipped without reading,
+/// a member excluded by one of its directories too. Hard links get data of
+/// their target, symbolic links are skipped. Throws on malformed pax header
+/// and on member data past the end of the archive.
+void for_each_tar_member(
+    const std::string &archive,
+    const PathFilter *filter,
+    const std::function<void(const std::string &,
+                             uint64_t,
+                             std::shared_ptr<const std::string>)> &func)
 {
-    for (auto &p : std::filesystem::directory_iterator(path))
+    ProfileSpan span("archive", archive);
+    using Data = std::pair<uint64_t, std::shared_ptr<const std::string>>;
+    std::map<std::string, Data> read; // for hard links
+
+    std::error_code error;
+    uint64_t archive_size = std::filesystem::file_size(archive, error);
+    std::ifstream file(archive, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+
+    char header[512];
+    uint64_t offset = 0;
+    std::string long_name;
+    std::string long_link;
+    std::string pax;
+    while (file.read(header, sizeof(header)))
     {
-        if (std::filesystem::is_directory(p))
-            for_each_directory_file_recursive(p.path().string(), func);
+        offset += sizeof(header);
+        if (header[0] == '\0')
+            break; // end of archive
+
+        uint64_t size = tar_number(header + 124, 12);
+        char type = header[156];
+        std::string link(header + 157, strnlen(header + 157, 100));
+        std::string name;
+        if (!long_name.empty())
+            name = long_name;
         else
-            func(p.path().string());
+        {
+            name.assign(header, strnlen(header, 100));
+            if (memcmp(header + 257, "ustar", 5) == 0 && header[345])
+                name = std::string(header + 345, strnlen(header + 345, 155)) +
+                       "/" + name;
+        }
+        std::string value;
+        if (pax_value(pax, "path", value))
+            name = value;
+        if (pax_value(pax, "size", value) && !parse_decimal(value, size))
+            throw std::runtime_error("bad pax header in " + archive);
+        if (pax_value(pax, "linkpath", value))
+            link = value;
+        if (error || size > archive_size - offset)
+            throw std::runtime_error("truncated archive " + archive);
+        uint64_t padded = (size + 511) / 512 * 512;
+
+        if (!long_link.empty())
+            link = long_link;
+        if (type == 'L' || type == 'K' || type == 'x')
+        {
+            std::string data(size, '\0');
+            file.read(&data[0], size);
+            if ((uint64_t)file.gcount() != size)
+                throw std::runtime_error("truncated archive " + archive);
+            file.ignore(padded - size);
+            offset += padded;
+            if (type == 'L')
+                long_name = data.c_str();
+            else if (type == 'K')
+                long_link = data.c_str();
+            else if (pax_valid(data))
+                pax = data;
+            else
+                throw std::runtime_error("bad pax header in " + archive);
+            continue;
+        }
+        long_name.clear();
+        long_link.clear();
+        pax.clear();
+
+        while (name.compare(0, 2, "./") == 0)
+            name.erase(0, 2);
+        while (link.compare(0, 2, "./") == 0)
+            link.erase(0, 2);
+        bool regular = type == '0' || type == '\0' || type == '7';
+        bool hardlink = type == '1' && read.count(link);
+        bool excluded =
+            !(regular || hardlink) || name.empty() || name.back() == '/';
+        for (size_t slash = 0; !excluded && slash != std::string::npos;
+             slash = name.find('/', slash + 1))
+            excluded = filter_excludes(filter, name.substr(0, slash));
+        excluded = excluded || filter_excludes(filter, name) ||
+                   !filter_includes(filter, name);
+
+        if (excluded || hardlink)
+            file.ignore(padded);
+        if (hardlink && !excluded)
+        {
+            read[name] = read[link];
+            func(name, read[name].first, read[name].second);
+        }
+        else if (!excluded)
+        {
+            std::string data(size, '\0');
+            file.read(&data[0], size);
+            if ((uint64_t)file.gcount() != size)
+                throw std::runtime_error("truncated archive " + archive);
+            file.ignore(padded - size);
+            span.add_bytes(size);
+            read[name] = {offset,
+                          std::make_shared<const std::string>(std::move(data))};
+            func(name, offset, read[name].second);
+        }
+        offset += padded;
+    }
+}
+
+/// Reads patterns of ignore file, one per line. Missing file is empty.
+std::vector<std::string> read_ignore_file(const std::string &path)
+{
+    std::vector<std::string> patterns;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        auto pattern = trim(line);
+        if (pattern.empty() || pattern[0] == '#')
+            continue;
+        patterns.push_back(pattern);
+    }
+    return patterns;
+}
+
+/// Default ignore file: .irccignore next to listfile
+std::string default_ignore_file(const std::string &listfile)
+{
+    return (std::filesystem::path(listfile).parent_path() / ".irccignore")
+        .string();
+}
+
+/// Splits comma separated stages. Names defined by @stage directives are
+/// replaced by `cmd:COMMAND`.
+std::vector<std::string>
+parse_transforms(const std::string &list,
+                 const std::map<std::string, std::string> &commands)
+{
+    std::vector<std::string> stages;
+    std::stringstream stream(list);
+    std::string stage;
+    while (std::getline(stream, stage, ','))
+    {
+        auto it = commands.find(stage);
+        stages.push_back(it == commands.end() ? stage : "cmd:" + it->second);
     }
+    return stages;
 }
 
-std::vector<KeySource> get_sources_from_file(std::string listfile)
+/// Parses listfile. If `directories` is given, all scanned directories are
+/// appended to it. Patterns of `ignorefile` exclude entries of every
+/// directory syntax entry.
+std::vector<KeySource>
+get_sources_from_file(std::string listfile,
+                      std::vector<std::string> *directories = nullptr,
+                      const std::string &ignorefile = {})
 {
     std::vector<KeySource> sources;
+    auto ignored = read_ignore_file(ignorefile);
     std::ifstream file(listfile);
+    std::vector<std::string> lines;
     std::string line;
     while (std::getline(file, line))
     {
@@ -108,27 +861,127 @@ std::vector<KeySource> get_sources_from_file(std::string listfile)
             continue;
         if (trimmed_line[0] == '#')
             continue;
+        lines.push_back(trimmed_line);
+    }
+
+    // directives apply to the whole listfile:
+    // @stage NAME COMMAND, @transform .EXT STAGE[,STAGE...]
+    std::map<std::string, std::string> commands;
+    std::map<std::string, std::string> extension_transforms;
+    for (auto &trimmed_line : lines)
+    {
+        if (trimmed_line[0] != '@')
+            continue;
+        std::stringstream stream(trimmed_line);
+        std::string directive, name, rest;
+        stream >> directive >> name;
+        std::getline(stream, rest);
+        if (directive == "@stage")
+            commands[name] = trim(rest);
+        else if (directive == "@transform")
+            extension_transforms[name] = trim(rest);
+        else
+            std::cout << "Unknown directive " << directive << std::endl;
+    }
+    auto transforms_of = [&](const std::string &path)
+    {
+        auto ext = std::filesystem::path(path).extension().string();
+        auto it = extension_transforms.find(ext);
+        if (it == extension_transforms.end())
+            return std::vector<std::string>();
+        return parse_transforms(it->second, commands);
+    };
+
+    for (auto &trimmed_line : lines)
+    {
+        if (trimmed_line[0] == '@')
+            continue;
 
         std::string key = trimmed_line.substr(0, trimmed_line.find(" "));
         std::string source = trimmed_line.substr(trimmed_line.find(" ") + 1);
 
-        if (is_directory(source))
+        // trailing --include=GLOB and --exclude=GLOB filter directory entry,
+        // --transform=STAGES replaces transforms by extension, --warm
+        // prefetches resources at startup
+        PathFilter filter;
+        filter.exclude = ignored;
+        std::vector<std::string> transforms;
+        bool entry_transforms = false;
+        bool warm = false;
+        size_t space;
+        while ((space = source.rfind(' ')) != std::string::npos &&
+               source.compare(space + 1, 2, "--") == 0)
+        {
+            std::string option = source.substr(space + 1);
+            if (option.rfind("--include=", 0) == 0)
+                filter.include.push_back(option.substr(10));
+            else if (option.rfind("--exclude=", 0) == 0)
+                filter.exclude.push_back(option.substr(10));
+            else if (option.rfind("--transform=", 0) == 0)
+            {
+                auto stages = parse_transforms(option.substr(12), commands);
+                transforms.insert(
+                    transforms.begin(), stages.begin(), stages.end());
+                entry_transforms = true;
+            }
+            else if (option == "--warm")
+                warm = true;
+            else
+                break;
+            source = trim(source.substr(0, space));
+        }
+        auto transforms_for = [&](const std::string &path)
+        { return entry_transforms ? transforms : transforms_of(path); };
+        size_t first = sources.size();
+
+        if (is_archive(source))
+        {
+            // the last of duplicate members wins, as on extraction
+            std::map<std::string, size_t> members;
+            for_each_tar_member(
+                source,
+                &filter,
+                [&](const std::string &member,
+                    uint64_t offset,
+                    std::shared_ptr<const std::string> data)
+                {
+                    KeySource keysource{
+                        key + member, source, transforms_for(member)};
+                    keysource.member = member;
+                    keysource.offset = offset;
+                    keysource.data = data;
+                    auto it = members.find(member);
+                    if (it != members.end())
+                        sources[it->second] = keysource;
+                    else
+                    {
+                        members[member] = sources.size();
+                        sources.push_back(keysource);
+                    }
+                });
+        }
+        else if (is_directory(source))
         {
             for_each_directory_file_recursive(
                 source,
-                [&sources, &source, &key](const std::string &file)
+                [&](const std::string &file)
                 {
                     auto filepath = std::filesystem::path(file);
                     auto dirpath = std::filesystem::path(source);
                     auto relative_path = filepath.lexically_relative(dirpath);
                     auto join_path = key + std::string(relative_path);
-                    sources.push_back(KeySource{join_path, file});
-                });
+                    sources.push_back(
+                        KeySource{join_path, file, transforms_for(file)});
+                },
+                directories,
+                &filter);
         }
         else
         {
-            sources.push_back(KeySource{key, source});
+            sources.push_back(KeySource{key, source, transforms_for(source)});
         }
+        for (size_t i = first; i < sources.size(); ++i)
+            sources[i].warm = warm;
     }
     return sources;
 }
@@ -158,6 +1011,13 @@ void sort_sources(std::vector<KeySource> &sources)
 
 KeyText keysource_to_keytext(KeySource source)
 {
+    ProfileSpan span("read", source.key, true);
+    if (source.data)
+    {
+        span.add_bytes(source.data->size());
+        return KeyText{source.key, *source.data};
+    }
+
     char buf[1024];
     std::ifstream file(source.source);
     std::string text;
@@ -166,6 +1026,7 @@ KeyText keysource_to_keytext(KeySource source)
     {
         text.append(buf, readed);
     }
+    span.add_bytes(text.size());
     return KeyText{source.key, text};
 }
 
@@ -179,38 +1040,681 @@ std::vector<KeyText> keysources_to_keytexts(std::vector<KeySource> sources)
     return keytexts;
 }
 
-KeyBytes keytext_to_keybytes(KeyText text)
+/// FNV-1a hash. Used where the result must not depend on the platform.
+uint64_t fnv1a64(const std::string &text)
 {
-    std::string bytes;
-    for (char c : text.text)
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text)
     {
-        bytes += "\\x" + uint8_to_hex(c);
+        hash ^= c;
+        hash *= 1099511628211ull;
     }
-    return KeyBytes{text.key, bytes};
+    return hash;
 }
 
-std::vector<KeyBytes> keytexts_to_keybytes(std::vector<KeyText> keytexts)
+/// Runs `func(i)` for i in [0, count) on several threads. The first exception
+/// thrown by `func` is rethrown after all threads finish.
+void parallel_for(size_t count, const std::function<void(size_t)> &func)
 {
-    std::vector<KeyBytes> keybytes;
-    std::transform(keytexts.begin(),
-                   keytexts.end(),
-                   std::back_inserter(keybytes),
-                   keytext_to_keybytes);
-    return keybytes;
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]()
+    {
+        size_t i;
+        while ((i = next.fetch_add(1)) < count)
+        {
+            try
+            {
+                func(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    size_t workers = std::min<size_t>(
+        std::clamp(std::thread::hardware_concurrency(), 1u, 16u), count);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
 }
 
-KeyBytesDivided keybytes_to_keybytesdivided(KeyBytes keybytes, int tabs)
+/// Removes whitespace outside of JSON strings
+std::string transform_json(const std::string &text)
 {
-    size_t size = keybytes.bytes.size();
-    size_t writed = 0;
-    std::string compiled;
-
-    if (size == 0)
+    std::string out;
+    bool in_string = false;
+    for (size_t i = 0; i < text.size(); ++i)
     {
-        for (int i = 0; i < tabs; i++)
-            compiled += "\t";
-        compiled += "\"\"\n";
-        return KeyBytesDivided{keybytes.key, compiled};
+        char c = text[i];
+        if (in_string)
+        {
+            out += c;
+            if (c == '\\' && i + 1 < text.size())
+                out += text[++i];
+            else if (c == '"')
+                in_string = false;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            continue;
+        if (c == '"')
+            in_string = true;
+        out += c;
+    }
+    return out;
+}
+
+/// Collapses every whitespace run to one character: newline if the run
+/// contains one, space otherwise. Leading and trailing whitespace is removed.
+std::string transform_whitespace(const std::string &text)
+{
+    std::string out;
+    bool space = false;
+    bool newline = false;
+    for (char c : text)
+    {
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            space = true;
+            newline = newline || c == '\n';
+            continue;
+        }
+        if (space && !out.empty())
+            out += newline ? '\n' : ' ';
+        space = newline = false;
+        out += c;
+    }
+    return out;
+}
+
+/// Removes /* */ comments and, if `line_comments`, // comments. Quoted
+/// strings ('...', "...", `...`) are kept as is.
+std::string transform_c_comments(const std::string &text, bool line_comments)
+{
+    std::string out;
+    char quote = 0;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        char c = text[i];
+        if (quote)
+        {
+            out += c;
+            if (c == '\\' && i + 1 < text.size())
+                out += text[++i];
+            else if (c == quote)
+                quote = 0;
+            continue;
+        }
+        if (c == '"' || c == '\'' || c == '`')
+            quote = c;
+        else if (text.compare(i, 2, "/*") == 0)
+        {
+            auto end = text.find("*/", i + 2);
+            i = end == std::string::npos ? text.size() : end + 1;
+            continue;
+        }
+        else if (line_comments && text.compare(i, 2, "//") == 0)
+        {
+            auto end = text.find('\n', i);
+            if (end == std::string::npos)
+                break;
+            i = end - 1;
+            continue;
+        }
+        out += c;
+    }
+    return out;
+}
+
+/// Removes <!-- --> comments
+std::string transform_html_comments(const std::string &text)
+{
+    std::string out;
+    size_t pos = 0;
+    size_t start;
+    while ((start = text.find("<!--", pos)) != std::string::npos)
+    {
+        out.append(text, pos, start - pos);
+        auto end = text.find("-->", start + 4);
+        pos = end == std::string::npos ? text.size() : end + 3;
+    }
+    out.append(text, pos, std::string::npos);
+    return out;
+}
+
+/// Converts JSON text to the binary form read in place by ircc_json.h.
+/// Values are written after their children, the header points to the root.
+class JsonBinaryWriter
+{
+public:
+    explicit JsonBinaryWriter(const std::string &text) : text(text) {}
+
+    std::string convert()
+    {
+        out = "IRJB";
+        put<uint32_t>(0);
+        uint32_t root = value();
+        skip_whitespace();
+        if (pos != text.size())
+            fail("trailing characters");
+        out.replace(4, 4, little_endian(root));
+        return out;
+    }
+
+private:
+    const std::string &text;
+    std::string out;
+    size_t pos = 0;
+
+    enum
+    {
+        TAG_NULL,
+        TAG_FALSE,
+        TAG_TRUE,
+        TAG_INT,
+        TAG_DOUBLE,
+        TAG_STRING,
+        TAG_ARRAY,
+        TAG_OBJECT,
+    };
+
+    [[noreturn]] void fail(const std::string &what)
+    {
+        throw std::runtime_error("json: " + what + " at offset " +
+                                 std::to_string(pos));
+    }
+
+    /// Bytes of value in little endian, whatever the host byte order is
+    template <class T> static std::string little_endian(T value)
+    {
+        std::string bytes(sizeof(T), '\0');
+        memcpy(&bytes[0], &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        std::reverse(bytes.begin(), bytes.end());
+#endif
+        return bytes;
+    }
+
+    template <class T> void put(T value)
+    {
+        out += little_endian(value);
+    }
+
+    uint32_t offset()
+    {
+        if (out.size() > UINT32_MAX)
+            fail("document is too large");
+        return (uint32_t)out.size();
+    }
+
+    void skip_whitespace()
+    {
+        while (pos < text.size() && strchr(" \t\r\n", text[pos]) && text[pos])
+            ++pos;
+    }
+
+    bool consume(const char *literal)
+    {
+        size_t len = strlen(literal);
+        if (text.compare(pos, len, literal) != 0)
+            return false;
+        pos += len;
+        return true;
+    }
+
+    void expect(char c)
+    {
+        skip_whitespace();
+        if (pos >= text.size() || text[pos] != c)
+            fail(std::string("expected '") + c + "'");
+        ++pos;
+    }
+
+    uint32_t value()
+    {
+        skip_whitespace();
+        if (pos >= text.size())
+            fail("unexpected end");
+        uint32_t at = offset();
+        char c = text[pos];
+        if (c == '{')
+            return object();
+        if (c == '[')
+            return array();
+        if (c == '"')
+            return string_value(parse_string());
+        if (consume("null"))
+            out += (char)TAG_NULL;
+        else if (consume("false"))
+            out += (char)TAG_FALSE;
+        else if (consume("true"))
+            out += (char)TAG_TRUE;
+        else
+            number();
+        return at;
+    }
+
+    void number()
+    {
+        size_t start = pos;
+        bool integer = true;
+        if (pos < text.size() && text[pos] == '-')
+            ++pos;
+        while (pos < text.size() && strchr("0123456789.eE+-", text[pos]) &&
+               text[pos])
+        {
+            if (!isdigit((unsigned char)text[pos]))
+                integer = false;
+            ++pos;
+        }
+        std::string literal = text.substr(start, pos - start);
+        if (literal.empty() || literal == "-")
+            fail("unexpected character");
+
+        char *end;
+        errno = 0;
+        long long ivalue = strtoll(literal.c_str(), &end, 10);
+        if (integer && errno == 0 && *end == 0)
+        {
+            out += (char)TAG_INT;
+            put<int64_t>(ivalue);
+            return;
+        }
+        double dvalue = strtod(literal.c_str(), &end);
+        if (*end != 0)
+            fail("bad number");
+        out += (char)TAG_DOUBLE;
+        put<double>(dvalue);
+    }
+
+    void append_utf8(std::string &str, uint32_t code)
+    {
+        if (code < 0x80)
+            str += (char)code;
+        else if (code < 0x800)
+        {
+            str += (char)(0xC0 | (code >> 6));
+            str += (char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            str += (char)(0xE0 | (code >> 12));
+            str += (char)(0x80 | ((code >> 6) & 0x3F));
+            str += (char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            str += (char)(0xF0 | (code >> 18));
+            str += (char)(0x80 | ((code >> 12) & 0x3F));
+            str += (char)(0x80 | ((code >> 6) & 0x3F));
+            str += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    uint32_t parse_hex4()
+    {
+        if (pos + 4 > text.size())
+            fail("bad escape");
+        uint32_t code = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = text[pos++];
+            if (!isxdigit((unsigned char)c))
+                fail("bad escape");
+            int digit = isdigit((unsigned char)c) ? c - '0'
+                                                  : (c | 0x20) - 'a' + 10;
+            code = code * 16 + digit;
+        }
+        return code;
+    }
+
+    std::string parse_string()
+    {
+        expect('"');
+        std::string str;
+        while (true)
+        {
+            if (pos >= text.size())
+                fail("unterminated string");
+            char c = text[pos++];
+            if (c == '"')
+                return str;
+            if (c != '\\')
+            {
+                str += c;
+                continue;
+            }
+            if (pos >= text.size())
+                fail("unterminated string");
+            c = text[pos++];
+            switch (c)
+            {
+            case 'b':
+                str += '\b';
+                break;
+            case 'f':
+                str += '\f';
+                break;
+            case 'n':
+                str += '\n';
+                break;
+            case 'r':
+                str += '\r';
+                break;
+            case 't':
+                str += '\t';
+                break;
+            case 'u':
+            {
+                uint32_t code = parse_hex4();
+                size_t mark = pos;
+                if (code >= 0xD800 && code < 0xDC00 && consume("\\u"))
+                {
+                    uint32_t low = parse_hex4();
+                    if (low >= 0xDC00 && low < 0xE000)
+                        code =
+                            0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    else
+                        pos = mark; // not a pair, next escape stands alone
+                }
+                if (code >= 0xD800 && code < 0xE000)
+                    code = 0xFFFD; // unpaired surrogate
+                append_utf8(str, code);
+                break;
+            }
+            default:
+                str += c;
+            }
+        }
+    }
+
+    uint32_t string_value(const std::string &str)
+    {
+        uint32_t at = offset();
+        out += (char)TAG_STRING;
+        put<uint32_t>(str.size());
+        out += str;
+        out += '\0';
+        return at;
+    }
+
+    uint32_t array()
+    {
+        expect('[');
+        std::vector<uint32_t> elements;
+        skip_whitespace();
+        if (!consume("]"))
+        {
+            do
+                elements.push_back(value());
+            while (skip_whitespace(), consume(","));
+            expect(']');
+        }
+        uint32_t at = offset();
+        out += (char)TAG_ARRAY;
+        put<uint32_t>(elements.size());
+        for (auto element : elements)
+            put<uint32_t>(element);
+        return at;
+    }
+
+    uint32_t object()
+    {
+        expect('{');
+        std::map<std::string, std::pair<uint32_t, uint32_t>> entries;
+        skip_whitespace();
+        if (!consume("}"))
+        {
+            do
+            {
+                skip_whitespace();
+                auto key = parse_string();
+                uint32_t key_offset = string_value(key);
+                expect(':');
+                // the last of duplicate keys wins, as in most parsers
+                entries[key] = {key_offset, value()};
+            } while (skip_whitespace(), consume(","));
+            expect('}');
+        }
+        uint32_t at = offset();
+        out += (char)TAG_OBJECT;
+        put<uint32_t>(entries.size());
+        for (auto &[key, entry] : entries)
+        {
+            put<uint32_t>(entry.first);
+            put<uint32_t>(entry.second);
+        }
+        return at;
+    }
+};
+
+std::string read_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+}
+
+/// Unique name of temporary file of this thread
+std::string temporary_path(const std::string &prefix)
+{
+    std::ostringstream name;
+    name << prefix << ".tmp-" << getpid() << "-"
+         << std::this_thread::get_id();
+    return name.str();
+}
+
+/// Replaces file atomically, so a build never sees half written file
+void write_file_atomic(const std::string &path, const std::string &text)
+{
+    std::string tmp = temporary_path(path);
+    std::ofstream(tmp, std::ios::binary) << text;
+    std::filesystem::rename(tmp, path);
+}
+
+void write_file_if_changed(const std::string &path, const std::string &text)
+{
+    if (std::filesystem::exists(path) && read_file(path) == text)
+        return;
+    write_file_atomic(path, text);
+}
+
+/// Runs `command` with /bin/sh, file `input` on stdin and file `output` on
+/// stdout. Returns true on zero exit status.
+bool run_command(const std::string &command,
+                 const std::string &input,
+                 const std::string &output)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(
+        &actions, STDIN_FILENO, input.c_str(), O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions,
+                                     STDOUT_FILENO,
+                                     output.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC,
+                                     0644);
+    const char *argv[] = {"sh", "-c", command.c_str(), NULL};
+    pid_t pid;
+    int err = posix_spawn(
+        &pid, "/bin/sh", &actions, NULL, (char *const *)argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0)
+        return false;
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/// Applies one stage. Stages are built-in names or `cmd:COMMAND`, commands
+/// use `workdir` for their temporary files.
+std::string apply_transform(const std::string &stage,
+                            const std::string &text,
+                            const std::string &workdir)
+{
+    if (stage == "json")
+        return transform_json(text);
+    if (stage == "ws")
+        return transform_whitespace(text);
+    if (stage == "c-comments")
+        return transform_c_comments(text, true);
+    if (stage == "block-comments")
+        return transform_c_comments(text, false);
+    if (stage == "html-comments")
+        return transform_html_comments(text);
+    if (stage == "jsonb")
+        return JsonBinaryWriter(text).convert();
+    if (stage.rfind("cmd:", 0) != 0)
+        throw std::runtime_error("unknown transform stage " + stage);
+
+    std::string name = temporary_path(workdir + "/stage");
+    std::string input = name + ".in";
+    std::string output = name + ".out";
+    std::ofstream(input, std::ios::binary) << text;
+    bool ok = run_command(stage.substr(4), input, output);
+    std::string result = read_file(output);
+    std::filesystem::remove(input);
+    std::filesystem::remove(output);
+    if (!ok)
+        throw std::runtime_error("command failed: " + stage.substr(4));
+    return result;
+}
+
+/// Applies transform stages of `source` to `text`. Results are stored in
+/// `cache_dir` under hash of stages and input, so unchanged inputs are not
+/// transformed again. Returns path of the stored result.
+std::string transform_resource(const KeySource &source,
+                               std::string &text,
+                               const std::string &cache_dir)
+{
+    ProfileSpan span("transform", source.key, true);
+    span.add_bytes(text.size());
+    std::string stages;
+    for (auto &stage : source.transforms)
+        stages += stage + '\0';
+    char name[64];
+    snprintf(name,
+             sizeof(name),
+             "%016llx-%zx",
+             (unsigned long long)fnv1a64(stages + '\0' + text),
+             text.size());
+    auto path = cache_dir + "/" + name;
+
+    std::ifstream cached(path, std::ios::binary);
+    if (cached.good())
+    {
+        text = read_file(path);
+        return path;
+    }
+
+    try
+    {
+        for (auto &stage : source.transforms)
+            text = apply_transform(stage, text, cache_dir);
+    }
+    catch (const std::runtime_error &e)
+    {
+        throw std::runtime_error(source.source + ": " + e.what());
+    }
+    write_file_atomic(path, text);
+    return path;
+}
+
+/// Reads resources and applies their transform stages, several resources
+/// at once
+std::vector<KeyText> load_keytexts(const std::vector<KeySource> &sources,
+                                   const std::string &cache_dir)
+{
+    if (!cache_dir.empty())
+        std::filesystem::create_directories(cache_dir);
+    std::vector<KeyText> keytexts(sources.size());
+    parallel_for(sources.size(),
+                 [&](size_t i)
+                 {
+                     keytexts[i] = keysource_to_keytext(sources[i]);
+                     if (!sources[i].transforms.empty())
+                         transform_resource(
+                             sources[i], keytexts[i].text, cache_dir);
+                 });
+    return keytexts;
+}
+
+KeyBytes keytext_to_keybytes(KeyText text)
+{
+    ProfileSpan span("encode", text.key, true);
+    span.add_bytes(text.text.size());
+    std::string bytes;
+    for (char c : text.text)
+    {
+        bytes += "\\x" + uint8_to_hex(c);
+    }
+    return KeyBytes{text.key, bytes, text.text.size()};
+}
+
+/// Describes resource without reading it. Payload is included by assembler
+/// (.incbin), so generated source stays small. Transformed resources are
+/// included from the transform cache.
+KeyBytes keysource_to_incbin(KeySource source, const std::string &cache_dir)
+{
+    KeyBytes keybytes;
+    keybytes.key = source.key;
+    if (!source.transforms.empty())
+    {
+        std::filesystem::create_directories(cache_dir);
+        auto text = keysource_to_keytext(source).text;
+        keybytes.incbin = std::filesystem::absolute(
+                              transform_resource(source, text, cache_dir))
+                              .lexically_normal()
+                              .string();
+        keybytes.size = text.size();
+        return keybytes;
+    }
+    if (source.data)
+    {
+        keybytes.size = source.data->size();
+        keybytes.incbin_offset = source.offset;
+    }
+    else
+        keybytes.size = std::filesystem::file_size(source.source);
+    keybytes.incbin =
+        std::filesystem::absolute(source.source).lexically_normal().string();
+    return keybytes;
+}
+
+std::vector<KeyBytes> keytexts_to_keybytes(std::vector<KeyText> keytexts)
+{
+    std::vector<KeyBytes> keybytes;
+    std::transform(keytexts.begin(),
+                   keytexts.end(),
+                   std::back_inserter(keybytes),
+                   keytext_to_keybytes);
+    return keybytes;
+}
+
+KeyBytesDivided keybytes_to_keybytesdivided(KeyBytes keybytes, int tabs)
+{
+    size_t size = keybytes.bytes.size();
+    size_t writed = 0;
+    std::string compiled;
+
+    if (size == 0)
+    {
+        for (int i = 0; i < tabs; i++)
+            compiled += "\t";
+        compiled += "\"\"\n";
+        return KeyBytesDivided{keybytes.key, compiled};
     }
 
     while (size - writed != 0)
@@ -227,9 +1731,17 @@ KeyBytesDivided keybytes_to_keybytesdivided(KeyBytes keybytes, int tabs)
     return KeyBytesDivided{keybytes.key, compiled};
 }
 
-std::string compile_headers(bool cpp_enabled)
+std::string compile_headers(bool cpp_enabled, bool interpose_enabled)
 {
     std::string headers;
+    if (interpose_enabled)
+    {
+        // fortified inline wrappers would clash with interposed functions
+        headers += "#undef _FORTIFY_SOURCE\n";
+    }
+    headers += "#ifndef _GNU_SOURCE\n";
+    headers += "#define _GNU_SOURCE\n";
+    headers += "#endif\n";
     if (cpp_enabled)
     {
         headers += "#include <string>\n";
@@ -238,153 +1750,2828 @@ std::string compile_headers(bool cpp_enabled)
     }
     headers += "#include <string.h>\n";
     headers += "#include <stdlib.h>\n";
+    headers += "#include <stdio.h>\n";
+    headers += "#include <stdint.h>\n";
+    headers += "#ifdef __linux__\n";
+    headers += "#include <fcntl.h>\n";
+    headers += "#include <sys/mman.h>\n";
+    headers += "#include <unistd.h>\n";
+    headers += "#endif\n";
     return headers;
 }
 
-std::string compile_ircc_resources_consts(std::vector<KeyBytes> keybytes)
-{
-    std::string compiled;
-    for (int i = 0; i < keybytes.size(); i++)
+/// Symbol names of payloads and their distribution between shards. A
+/// resource goes to the shard chosen by hash of its key, so adding or
+/// removing a resource rewrites a single shard only. Payloads are emitted
+/// in `order`: by rank in access profile, then by key. Huge payloads go to
+/// section aligned for huge pages.
+struct PayloadLayout
+{
+    std::vector<std::string> names;
+    std::vector<std::vector<size_t>> shards; // < resource indexes, in order
+    std::vector<size_t> order;               // < resource indexes
+    std::vector<bool> huge;                  // < by resource index
+    bool blob = false; // < other payloads are parts of IRCC_BLOB_
+};
+
+PayloadLayout layout_payloads(const std::vector<KeyBytes> &keybytes,
+                              size_t shards,
+                              const std::map<std::string, size_t> &profile,
+                              uint64_t huge_threshold)
+{
+    PayloadLayout layout;
+    layout.shards.resize(shards);
+    for (auto &resource : keybytes)
+        layout.huge.push_back(huge_threshold != 0 &&
+                              resource.size >= huge_threshold);
+    for (size_t i = 0; i < keybytes.size(); ++i)
+    {
+        if (shards <= 1)
+        {
+            layout.names.push_back("IRCC_RESOURCES_" + std::to_string(i));
+            layout.shards[0].push_back(i);
+            continue;
+        }
+        size_t shard = fnv1a64(keybytes[i].key) % shards;
+        layout.names.push_back("IRCC_RESOURCES_" + std::to_string(shard) +
+                               "_" +
+                               std::to_string(layout.shards[shard].size()));
+        layout.shards[shard].push_back(i);
+    }
+
+    // keys are sorted, so resources of the same rank stay grouped by
+    // directory
+    auto rank = [&](size_t i)
+    {
+        auto it = profile.find(keybytes[i].key);
+        return it == profile.end() ? SIZE_MAX : it->second;
+    };
+    auto hotter = [&](size_t a, size_t b) { return rank(a) < rank(b); };
+    for (size_t i = 0; i < keybytes.size(); ++i)
+        layout.order.push_back(i);
+    std::stable_sort(layout.order.begin(), layout.order.end(), hotter);
+    for (auto &shard : layout.shards)
+        std::stable_sort(shard.begin(), shard.end(), hotter);
+
+    // separate literals may be placed in any order, parts of one array may
+    // not
+    layout.blob = !profile.empty() && shards <= 1 &&
+                  std::all_of(keybytes.begin(),
+                              keybytes.end(),
+                              [](const KeyBytes &keybytes)
+                              { return keybytes.incbin.empty(); }) &&
+                  std::count(layout.huge.begin(), layout.huge.end(), false);
+    uint64_t offset = 0;
+    for (size_t i : layout.order)
+    {
+        if (!layout.blob || layout.huge[i])
+            continue;
+        layout.names[i] = "(IRCC_BLOB_ + " + std::to_string(offset) + ")";
+        offset += keybytes[i].size + 1;
+    }
+    return layout;
+}
+
+/// Ranks of keys in access profile, 0 is the hottest. Profile is either a
+/// list of keys, hot first, or output of ircc_stats_dump: "key hits bytes"
+/// lines, keys without hits are not ranked.
+std::map<std::string, size_t> read_profile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.good())
+        throw std::runtime_error("cannot read profile " + path);
+
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    bool counted = false;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream stream(line);
+        std::string key;
+        uint64_t hits = 0;
+        stream >> key;
+        if (stream >> hits)
+            counted = true;
+        entries.emplace_back(key, hits);
+    }
+    if (counted)
+    {
+        std::stable_sort(entries.begin(),
+                         entries.end(),
+                         [](const auto &a, const auto &b)
+                         { return a.second > b.second; });
+        while (!entries.empty() && entries.back().second == 0)
+            entries.pop_back();
+    }
+
+    std::map<std::string, size_t> ranks;
+    for (auto &entry : entries)
+        ranks.emplace(entry.first, ranks.size());
+    return ranks;
+}
+
+/// Path of shard file: index is inserted before the last extension,
+/// resources.gen.cpp -> resources.gen.shard0.cpp
+std::string shard_path(const std::string &outfile, size_t shard)
+{
+    auto path = std::filesystem::path(outfile);
+    auto name = path.stem().string() + ".shard" + std::to_string(shard) +
+                path.extension().string();
+    return (path.parent_path() / name).string();
+}
+
+/// Escapes text for string literal of C and of assembler
+std::string escape_string(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+/// Section of payloads placed with --huge-threshold. Its start is aligned to
+/// 2 MB, so it may be backed by huge pages.
+const char *const HUGE_SECTION = "ircc_huge";
+
+/// Compiles definition of payload. With `shared` payload is visible for
+/// other translation units, which is needed when map and payload are in
+/// different shards. `huge` payload is placed to HUGE_SECTION.
+std::string compile_payload(const KeyBytes &keybytes,
+                            const std::string &name,
+                            bool shared,
+                            bool huge = false)
+{
+    std::string compiled;
+    std::string section = huge ? std::string(HUGE_SECTION) : ".rodata";
+    if (!keybytes.incbin.empty())
+    {
+        // size and mtime make text differ when the file changes, so build
+        // system recompiles this unit
+        struct stat st = {};
+        stat(keybytes.incbin.c_str(), &st);
+        auto mtime = std::to_string(st.st_mtim.tv_sec) + "." +
+                     std::to_string(st.st_mtim.tv_nsec);
+        auto path = escape_string(escape_string(keybytes.incbin));
+        compiled += "/* " + std::to_string(keybytes.size) + " bytes, mtime " +
+                    mtime + " */\n";
+        compiled += "__asm__(\".pushsection " + section +
+                    ",\\\"a\\\"\\n\"\n";
+        compiled += huge ? "        \".balign 64\\n\"\n"
+                         : "        \".balign 16\\n\"\n";
+        compiled += "        \".globl " + name + "\\n\"\n";
+        compiled += "        \".hidden " + name + "\\n\"\n";
+        compiled += "        \"" + name + ":\\n\"\n";
+        std::string range;
+        if (keybytes.incbin_offset != 0)
+            range = "," + std::to_string(keybytes.incbin_offset) + "," +
+                    std::to_string(keybytes.size);
+        compiled +=
+            "        \".incbin \\\"" + path + "\\\"" + range + "\\n\"\n";
+        compiled += "        \".byte 0\\n\"\n";
+        compiled += "        \".popsection\\n\");\n";
+        compiled += "IRCC_EXTERN_DECL const char " + name + "[];\n\n";
+        return compiled;
+    }
+
+    std::string attributes = " __attribute__((section(\"" + section +
+                             "\"), aligned(64)))";
+    if (shared)
+        compiled += "IRCC_EXTERN_DEF const char " + name + "[]" +
+                    (huge ? attributes : "") + " = \n";
+    else if (huge)
+        compiled += "static const char " + name + "[]" + attributes + " = \n";
+    else
+        compiled += "const char* const " + name + " = \n";
+    compiled += keybytes_to_keybytesdivided(keybytes, 2).bytes_divided;
+    compiled += ";\n\n";
+    return compiled;
+}
+
+/// Declarations which let payloads be referenced from another shard and from
+/// assembler
+std::string text_payload_linkage()
+{
+    return R"(#ifdef __cplusplus
+#define IRCC_EXTERN_DEF extern "C"
+#define IRCC_EXTERN_DECL extern "C"
+#else
+#define IRCC_EXTERN_DEF
+#define IRCC_EXTERN_DECL extern
+#endif
+)";
+}
+
+std::string
+compile_ircc_resources_consts(const std::vector<KeyBytes> &keybytes,
+                              const PayloadLayout &layout)
+{
+    std::string compiled;
+    bool sharded = layout.shards.size() > 1;
+    if (layout.blob)
+    {
+        compiled += "/* payloads in order of access profile, hot first */\n";
+        compiled += "static const char IRCC_BLOB_[] = \n";
+        for (size_t i : layout.order)
+        {
+            if (layout.huge[i])
+                continue;
+            compiled += keybytes_to_keybytesdivided(keybytes[i], 2)
+                            .bytes_divided;
+            compiled += "\n\t\t\"\\x00\"\n";
+        }
+        compiled += "\t\t;\n\n";
+    }
+    for (size_t i : layout.order)
+    {
+        if (sharded)
+            compiled +=
+                "IRCC_EXTERN_DECL const char " + layout.names[i] + "[];\n";
+        else if (!layout.blob || layout.huge[i])
+            compiled += compile_payload(
+                keybytes[i], layout.names[i], false, layout.huge[i]);
+    }
+    if (sharded)
+        compiled += "\n";
+    return compiled;
+}
+
+/// Composes source file with payloads of one shard
+std::string compile_shard(const std::vector<KeyBytes> &keybytes,
+                          const PayloadLayout &layout,
+                          size_t shard)
+{
+    std::string compiled = "/* ircc resources, shard " +
+                           std::to_string(shard) + " of " +
+                           std::to_string(layout.shards.size()) + " */\n";
+    compiled += text_payload_linkage();
+    compiled += "\n";
+    for (size_t i : layout.shards[shard])
+        compiled += compile_payload(
+            keybytes[i], layout.names[i], true, layout.huge[i]);
+    return compiled;
+}
+
+std::string compile_ircc_resources_map_cstyle(std::vector<KeyBytes> keybytes,
+                                              const PayloadLayout &layout)
+{
+
+    std::string compiled = "";
+    compiled += "struct key_value_size IRCC_RESOURCES_[] = {\n";
+    for (size_t i = 0; i < keybytes.size(); ++i)
+    {
+        compiled += "\t{\"" + keybytes[i].key + "\", ";
+        compiled += layout.names[i];
+        compiled += ", ";
+        compiled += std::to_string(keybytes[i].size);
+        compiled += "},\n";
+    }
+    compiled += "\t{NULL, NULL, 0}};\n";
+    return compiled;
+}
+
+std::string text_struct_key_value_size()
+{
+    return R"(struct key_value_size
+{
+    const char *key;
+    const char *value;
+    size_t size;
+};
+)";
+}
+
+/// Access counters of --counters build. Every thread counts to its own
+/// block with relaxed stores, blocks are pushed to lock-free list on first
+/// access and summed on read. Blocks outlive their threads, so counts of
+/// finished threads are kept; a new thread takes over a block of a finished
+/// one, so there are no more blocks than threads running at once.
+std::string text_counters_functions()
+{
+    return R"(#include <pthread.h>
+
+#define IRCC_RESOURCES_COUNT_ \
+    (sizeof(IRCC_RESOURCES_) / sizeof(IRCC_RESOURCES_[0]))
+
+struct ircc_counters
+{
+    struct ircc_counters *next;
+    int owned; /* by a running thread, the only writer */
+    uint64_t hits[IRCC_RESOURCES_COUNT_];
+    uint64_t bytes[IRCC_RESOURCES_COUNT_];
+};
+
+static struct ircc_counters *IRCC_COUNTERS_;
+static __thread struct ircc_counters *ircc_counters_local;
+static pthread_key_t ircc_counters_key;
+static pthread_once_t ircc_counters_once = PTHREAD_ONCE_INIT;
+static int ircc_counters_key_created;
+
+/* Thread exit hands the block over to the next new thread, its counts
+   stay in the sums */
+static void ircc_counters_release(void *block)
+{
+    struct ircc_counters *counters = (struct ircc_counters *)block;
+    ircc_counters_local = NULL;
+    __atomic_store_n(&counters->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void ircc_counters_make_key(void)
+{
+    ircc_counters_key_created =
+        pthread_key_create(&ircc_counters_key, ircc_counters_release) == 0;
+}
+
+/* no destructor may run in unloaded code of a module */
+__attribute__((destructor)) static void ircc_counters_delete_key(void)
+{
+    if (ircc_counters_key_created)
+        pthread_key_delete(ircc_counters_key);
+}
+
+static struct ircc_counters *ircc_counters_thread(void)
+{
+    struct ircc_counters *counters = ircc_counters_local;
+    int unowned = 0;
+    if (counters != NULL)
+        return counters;
+    pthread_once(&ircc_counters_once, ircc_counters_make_key);
+    if (!ircc_counters_key_created)
+        return NULL;
+
+    counters = __atomic_load_n(&IRCC_COUNTERS_, __ATOMIC_ACQUIRE);
+    for (; counters != NULL; counters = counters->next, unowned = 0)
+        if (__atomic_compare_exchange_n(&counters->owned,
+                                        &unowned,
+                                        1,
+                                        0,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED))
+            break;
+    if (counters == NULL)
+    {
+        counters = (struct ircc_counters *)calloc(1, sizeof(*counters));
+        if (counters == NULL)
+            return NULL;
+        counters->owned = 1;
+        counters->next = __atomic_load_n(&IRCC_COUNTERS_, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&IRCC_COUNTERS_,
+                                            &counters->next,
+                                            counters,
+                                            1,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+            ;
+    }
+    pthread_setspecific(ircc_counters_key, counters);
+    ircc_counters_local = counters;
+    return counters;
+}
+
+static struct key_value_size *ircc_count(struct key_value_size *kvs)
+{
+    struct ircc_counters *counters = ircc_counters_thread();
+    size_t no = kvs - IRCC_RESOURCES_;
+    if (counters == NULL)
+        return kvs;
+    /* the only writer of the block, readers need no more than atomicity */
+    __atomic_store_n(&counters->hits[no],
+                     __atomic_load_n(&counters->hits[no], __ATOMIC_RELAXED) +
+                         1,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&counters->bytes[no],
+                     __atomic_load_n(&counters->bytes[no], __ATOMIC_RELAXED) +
+                         kvs->size,
+                     __ATOMIC_RELAXED);
+    return kvs;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ircc_resource_stats
+{
+    uint64_t hits;
+    uint64_t bytes;
+};
+
+int ircc_stats_get(size_t no, struct ircc_resource_stats *stats)
+{
+    struct ircc_counters *counters;
+    if (no + 1 >= IRCC_RESOURCES_COUNT_)
+        return -1;
+    stats->hits = 0;
+    stats->bytes = 0;
+    counters = __atomic_load_n(&IRCC_COUNTERS_, __ATOMIC_ACQUIRE);
+    for (; counters != NULL; counters = counters->next)
+    {
+        stats->hits += __atomic_load_n(&counters->hits[no], __ATOMIC_RELAXED);
+        stats->bytes +=
+            __atomic_load_n(&counters->bytes[no], __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+void ircc_stats_dump(FILE *file)
+{
+    struct ircc_resource_stats stats;
+    size_t no;
+    for (no = 0; ircc_stats_get(no, &stats) == 0; ++no)
+        fprintf(file,
+                "%s %llu %llu\n",
+                IRCC_RESOURCES_[no].key,
+                (unsigned long long)stats.hits,
+                (unsigned long long)stats.bytes);
+}
+
+#ifdef __cplusplus
+}
+#endif
+)";
+}
+
+/// Blocked Bloom filter of --bloom build: a key sets BLOOM_PROBES bits in
+/// one 64 byte block, so a miss is rejected after reading one cache line.
+/// Block and bits are derived from FNV-1a 64 hash of the key, the same way
+/// as by generated ircc_bloom_check.
+const size_t BLOOM_BITS_PER_KEY = 12;
+const size_t BLOOM_PROBES = 6;
+
+std::string compile_bloom_filter(const std::vector<KeyBytes> &keybytes)
+{
+    size_t blocks =
+        std::max<size_t>(1, (keybytes.size() * BLOOM_BITS_PER_KEY + 511) / 512);
+    std::vector<uint64_t> words(blocks * 8);
+    for (auto &kb : keybytes)
+    {
+        uint64_t hash = fnv1a64(kb.key);
+        uint64_t *block = &words[((hash >> 32) * blocks >> 32) * 8];
+        uint64_t bits = (hash ^ (hash >> 31)) * 0x9e3779b97f4a7c15ULL;
+        for (size_t i = 0; i < BLOOM_PROBES; ++i, bits <<= 9)
+            block[(bits >> 55) >> 6] |= 1ULL << ((bits >> 55) & 63);
+    }
+
+    std::string compiled;
+    compiled += "#define IRCC_BLOOM_BLOCKS_ " + std::to_string(blocks) +
+                "ULL\n";
+    compiled += "static const uint64_t IRCC_BLOOM_[] "
+                "__attribute__((aligned(64))) = {\n";
+    char word[24];
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        snprintf(word,
+                 sizeof(word),
+                 "0x%016llxULL,",
+                 (unsigned long long)words[i]);
+        compiled += i % 4 == 0 ? "\t" : " ";
+        compiled += word;
+        compiled += i % 4 == 3 ? "\n" : "";
+    }
+    compiled += "};\n";
+    compiled += R"(
+/* 0 if key is surely not embedded */
+static int ircc_bloom_check(const char *key)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *c;
+    const uint64_t *block;
+    uint64_t bits;
+    int i;
+    for (c = (const unsigned char *)key; *c != 0; ++c)
+    {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    block = IRCC_BLOOM_ + ((hash >> 32) * IRCC_BLOOM_BLOCKS_ >> 32) * 8;
+    bits = (hash ^ (hash >> 31)) * 0x9e3779b97f4a7c15ULL;
+    for (i = 0; i < )" + std::to_string(BLOOM_PROBES) +
+                R"(; ++i, bits <<= 9)
+    {
+        if (!(block[(bits >> 55) >> 6] >> ((bits >> 55) & 63) & 1))
+            return 0;
+    }
+    return 1;
+}
+)";
+    return compiled;
+}
+
+/// Lookup of embedded resource. ircc_search does not count accesses, it is
+/// used by introspection functions. With --bloom most misses are rejected
+/// by the filter before the binary search.
+std::string text_binary_search_function(bool counters_enabled,
+                                        bool bloom_enabled)
+{
+    std::string found = counters_enabled
+                            ? "kvs != NULL ? ircc_count(kvs) : NULL"
+                            : "kvs";
+    std::string bloom = bloom_enabled ? R"(
+    if (!ircc_bloom_check(key))
+        return NULL;)"
+                                      : "";
+    return R"(static struct key_value_size *ircc_search(const char *key)
+{
+    int low = 0;
+    /* the last entry is the {NULL, NULL, 0} terminator */
+    int high = sizeof(IRCC_RESOURCES_) / sizeof(IRCC_RESOURCES_[0]) - 2;
+    int mid;)" + bloom + R"(
+    while (low <= high)
+    {
+        mid = (low + high) / 2;
+        int cmp = strcmp(key, IRCC_RESOURCES_[mid].key);
+        if (cmp < 0)
+            high = mid - 1;
+        else if (cmp > 0)
+            low = mid + 1;
+        else
+            return &IRCC_RESOURCES_[mid];
+    }
+    return NULL;
+}
+
+struct key_value_size *ircc_binary_search(const char *key)
+{
+    struct key_value_size *kvs = ircc_search(key);
+    return )" +
+           found + R"(;
+}
+)";
+}
+
+std::string text_lookup_function()
+{
+    return R"(static struct key_value_size *ircc_lookup(const char *key)
+{
+    return ircc_binary_search(key);
+}
+)";
+}
+
+std::string compile_dev_sources(const std::vector<KeySource> &sources)
+{
+    std::string compiled;
+    compiled += "static const char *const IRCC_SOURCES_[] = {\n";
+    for (auto &source : sources)
+    {
+        // archive members and transformed resources are served from the
+        // build
+        auto path = source.member.empty() && source.transforms.empty()
+                        ? std::filesystem::absolute(source.source).string()
+                        : std::string();
+        compiled += "\t\"" + escape_string(path) + "\",\n";
+    }
+    compiled += "\tNULL};\n";
+    return compiled;
+}
+
+/// Dev overlay: accessors read resources from their source files, cached
+/// until inotify reports a change. Compiled only without NDEBUG and only if
+/// IRCC_DEV environment variable is set at runtime.
+std::string text_dev_lookup_function(const std::vector<KeySource> &sources)
+{
+    std::string compiled = R"(#if !defined(NDEBUG) && defined(__linux__)
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+)";
+    compiled += compile_dev_sources(sources);
+    compiled += R"(
+struct ircc_dev_entry
+{
+    struct key_value_size *kvs; /* loaded copy, never freed */
+    int watch;
+    struct timespec mtime;
+};
+
+static struct ircc_dev_entry
+    IRCC_DEV_[sizeof(IRCC_RESOURCES_) / sizeof(IRCC_RESOURCES_[0])];
+static pthread_mutex_t ircc_dev_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int ircc_dev_inotify = -2;
+
+static int ircc_dev_enabled(void)
+{
+    static int enabled = -1;
+    int value = __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+    if (value < 0)
+    {
+        const char *env = getenv("IRCC_DEV");
+        value = env != NULL && *env != '\0' && strcmp(env, "0") != 0;
+        __atomic_store_n(&enabled, value, __ATOMIC_RELAXED);
+    }
+    return value;
+}
+
+/* Drops cached copies of changed files, called under ircc_dev_mutex */
+static void ircc_dev_drain(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(ircc_dev_inotify, buf, sizeof(buf))) > 0)
+    {
+        char *ptr = buf;
+        while (ptr < buf + len)
+        {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            /* a path renamed or deleted by an editor gets a new inode, which
+               is watched on the next load */
+            if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF))
+                inotify_rm_watch(ircc_dev_inotify, event->wd);
+            for (size_t i = 0; IRCC_SOURCES_[i] != NULL; i++)
+            {
+                if (IRCC_DEV_[i].watch != event->wd)
+                    continue;
+                IRCC_DEV_[i].kvs = NULL;
+                if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED))
+                    IRCC_DEV_[i].watch = -1;
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+static struct key_value_size *ircc_dev_load(const char *key, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *data = (char *)malloc(capacity + 1);
+    size_t n;
+    while (data != NULL && (n = fread(data + size, 1, capacity - size, file)))
+    {
+        size += n;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            char *grown = (char *)realloc(data, capacity + 1);
+            if (grown == NULL)
+                free(data);
+            data = grown;
+        }
+    }
+    fclose(file);
+    struct key_value_size *kvs =
+        (struct key_value_size *)malloc(sizeof(struct key_value_size));
+    if (data == NULL || kvs == NULL)
+    {
+        free(data);
+        free(kvs);
+        return NULL;
+    }
+    data[size] = '\0';
+    kvs->key = key;
+    kvs->value = data;
+    kvs->size = size;
+    return kvs;
+}
+
+static struct key_value_size *ircc_dev_overlay(struct key_value_size *kvs)
+{
+    size_t no = kvs - IRCC_RESOURCES_;
+    struct ircc_dev_entry *entry = &IRCC_DEV_[no];
+    struct stat st;
+    pthread_mutex_lock(&ircc_dev_mutex);
+    if (ircc_dev_inotify == -2)
+        ircc_dev_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ircc_dev_inotify >= 0)
+        ircc_dev_drain();
+    else if (entry->kvs != NULL &&
+             (stat(IRCC_SOURCES_[no], &st) < 0 ||
+              st.st_mtim.tv_sec != entry->mtime.tv_sec ||
+              st.st_mtim.tv_nsec != entry->mtime.tv_nsec))
+        entry->kvs = NULL;
+
+    if (entry->kvs == NULL)
+    {
+        /* watch before reading, so an edit during the read is not lost */
+        if (ircc_dev_inotify >= 0 && entry->watch <= 0)
+            entry->watch = inotify_add_watch(ircc_dev_inotify,
+                                             IRCC_SOURCES_[no],
+                                             IN_MODIFY | IN_CLOSE_WRITE |
+                                                 IN_ATTRIB | IN_MOVE_SELF |
+                                                 IN_DELETE_SELF);
+        if (stat(IRCC_SOURCES_[no], &st) == 0)
+            entry->mtime = st.st_mtim;
+        /* the previous copy is leaked, callers may still use it */
+        entry->kvs = ircc_dev_load(kvs->key, IRCC_SOURCES_[no]);
+    }
+    if (entry->kvs != NULL)
+        kvs = entry->kvs;
+    pthread_mutex_unlock(&ircc_dev_mutex);
+    return kvs;
+}
+
+static struct key_value_size *ircc_lookup(const char *key)
+{
+    struct key_value_size *kvs = ircc_binary_search(key);
+    if (kvs != NULL && ircc_dev_enabled() &&
+        IRCC_SOURCES_[kvs - IRCC_RESOURCES_][0] != '\0')
+        return ircc_dev_overlay(kvs);
+    return kvs;
+}
+#else
+)";
+    compiled += text_lookup_function();
+    compiled += "#endif\n";
+    return compiled;
+}
+
+std::string text_c_functions()
+{
+    return R"(#ifdef __cplusplus
+extern "C" const char *ircc_c_string(const char *key, size_t *sizeptr);
+#endif
+const char *ircc_c_string(const char *key, size_t *sizeptr)
+{
+    struct key_value_size *kvs = ircc_lookup(key);
+    if (kvs == NULL)
+        return NULL;
+    if (sizeptr != NULL)
+        *sizeptr = kvs->size;
+    return kvs->value;
+}
+
+#ifdef __cplusplus
+extern "C" const char *ircc_name_by_no(size_t no);
+#endif
+const char *ircc_name_by_no(size_t no)
+{
+    return IRCC_RESOURCES_[no].key;
+}
+)";
+}
+
+std::string text_fd_functions()
+{
+    return R"(#ifdef __linux__
+/* memfd of every resource + 1, zero until first ircc_fd call */
+static int IRCC_FDS_[sizeof(IRCC_RESOURCES_) / sizeof(IRCC_RESOURCES_[0])];
+
+static int ircc_fd_by_kvs(struct key_value_size *kvs)
+{
+    int *slot = &IRCC_FDS_[kvs - IRCC_RESOURCES_];
+    int cached = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (cached != 0)
+        return cached - 1;
+
+    /* not inherited by every exec'd program, callers hand it over with dup2
+       or clear FD_CLOEXEC */
+    int fd = memfd_create(strlen(kvs->key) < 200 ? kvs->key : "ircc",
+                          MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+    size_t written = 0;
+    while (written < kvs->size)
+    {
+        ssize_t n = write(fd, kvs->value + written, kvs->size - written);
+        if (n <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+    if (fcntl(fd,
+              F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    /* another thread may have raced us, keep the first published fd */
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(
+            slot, &expected, fd + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        close(fd);
+        return expected - 1;
+    }
+    return fd;
+}
+
+#ifdef __cplusplus
+extern "C" int ircc_fd(const char *key);
+#endif
+int ircc_fd(const char *key)
+{
+    struct key_value_size *kvs = ircc_binary_search(key);
+    if (kvs == NULL)
+        return -1;
+    return ircc_fd_by_kvs(kvs);
+}
+#endif
+)";
+}
+
+/// Page residency of payloads: mincore over page range of a payload and
+/// madvise helpers. Pages shared with neighbours are only counted, never
+/// dropped, but they are prefetched. Pages remapped by ircc_huge_remap are
+/// not dropped either, they have no copy in the binary any more.
+std::string text_residency_functions(bool huge_enabled)
+{
+    std::string huge = huge_enabled ? R"(
+    if (advice == MADV_DONTNEED && ircc_huge_remapped(start, length))
+        return -1;)"
+                                    : "";
+    return R"(#ifdef __linux__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ircc_residency
+{
+    size_t size;
+    size_t pages;
+    size_t resident;
+};
+
+/* Page range of payload. With `inner` only pages which hold nothing but the
+   payload are included. */
+static void ircc_payload_pages(const struct key_value_size *kvs,
+                               int inner,
+                               char **start,
+                               size_t *length)
+{
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)kvs->value;
+    uintptr_t end = begin + kvs->size;
+    if (inner)
+    {
+        begin = (begin + page - 1) & ~(page - 1);
+        end &= ~(page - 1);
+    }
+    else
+    {
+        begin &= ~(page - 1);
+        end = (end + page - 1) & ~(page - 1);
+    }
+    *start = (char *)begin;
+    *length = end > begin ? end - begin : 0;
+}
+
+static int ircc_residency_by_kvs(const struct key_value_size *kvs,
+                                 struct ircc_residency *res)
+{
+    unsigned char vec[256];
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char *start;
+    size_t length;
+    size_t done;
+    ircc_payload_pages(kvs, 0, &start, &length);
+    res->size = kvs->size;
+    res->pages = length / page;
+    res->resident = 0;
+    for (done = 0; done < res->pages;)
+    {
+        size_t count = res->pages - done;
+        size_t i;
+        if (count > sizeof(vec))
+            count = sizeof(vec);
+        if (mincore(start + done * page, count * page, vec) < 0)
+            return -1;
+        for (i = 0; i < count; ++i)
+            res->resident += vec[i] & 1;
+        done += count;
+    }
+    return 0;
+}
+
+int ircc_residency(const char *key, struct ircc_residency *res)
+{
+    struct key_value_size *kvs = ircc_search(key);
+    if (kvs == NULL)
+        return -1;
+    return ircc_residency_by_kvs(kvs, res);
+}
+
+void ircc_residency_report(FILE *file)
+{
+    struct key_value_size *kvs;
+    struct ircc_residency res;
+    for (kvs = IRCC_RESOURCES_; kvs->key != NULL; ++kvs)
+        if (ircc_residency_by_kvs(kvs, &res) == 0)
+            fprintf(file,
+                    "%s %zu %zu %zu\n",
+                    kvs->key,
+                    res.size,
+                    res.pages,
+                    res.resident);
+}
+
+static int ircc_advise(const char *key, int advice)
+{
+    struct key_value_size *kvs = ircc_search(key);
+    char *start;
+    size_t length;
+    if (kvs == NULL)
+        return -1;
+    ircc_payload_pages(kvs, 1, &start, &length);
+    if (length == 0)
+        return 0;)" + huge + R"(
+    return madvise(start, length, advice);
+}
+
+int ircc_cold(const char *key)
+{
+#ifdef MADV_COLD
+    return ircc_advise(key, MADV_COLD);
+#else
+    (void)key;
+    return -1;
+#endif
+}
+
+int ircc_drop(const char *key)
+{
+    return ircc_advise(key, MADV_DONTNEED);
+}
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
+static int ircc_prefetch_kvs(const struct key_value_size *kvs)
+{
+    char *start;
+    size_t length;
+    ircc_payload_pages(kvs, 0, &start, &length);
+    if (length == 0)
+        return 0;
+    /* populate reads pages in now (Linux 5.14), willneed only starts
+       readahead */
+    if (madvise(start, length, MADV_POPULATE_READ) == 0)
+        return 0;
+    return madvise(start, length, MADV_WILLNEED);
+}
+
+int ircc_prefetch(const char *key)
+{
+    struct key_value_size *kvs = ircc_search(key);
+    if (kvs == NULL)
+        return -1;
+    return ircc_prefetch_kvs(kvs);
+}
+
+/* Prefetches all resources with keys starting with prefix, returns their
+   count or -1 */
+int ircc_prefetch_prefix(const char *prefix)
+{
+    size_t len = strlen(prefix);
+    size_t low = 0;
+    size_t high = sizeof(IRCC_RESOURCES_) / sizeof(IRCC_RESOURCES_[0]) - 1;
+    int count = 0;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (strcmp(IRCC_RESOURCES_[mid].key, prefix) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    for (; IRCC_RESOURCES_[low].key != NULL &&
+           strncmp(IRCC_RESOURCES_[low].key, prefix, len) == 0;
+         ++low, ++count)
+        if (ircc_prefetch_kvs(&IRCC_RESOURCES_[low]) < 0)
+            return -1;
+    return count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+)";
+}
+
+/// Prefetch of resources marked with --warm. The application calls it at
+/// startup, on its own thread if it wants; generated code starts no threads,
+/// it may be a module which is unloaded at any time.
+std::string compile_warm(const std::vector<KeySource> &sources)
+{
+    std::string compiled = "#ifdef __linux__\n";
+    compiled += "static const size_t IRCC_WARM_[] = {\n";
+    for (size_t i = 0; i < sources.size(); ++i)
+        if (sources[i].warm)
+            compiled += "\t" + std::to_string(i) + ",\n";
+    compiled += "\t(size_t)-1};\n";
+    compiled += R"(
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Prefetches resources marked with --warm, returns their count or -1 */
+int ircc_prefetch_warm(void)
+{
+    int count;
+    for (count = 0; IRCC_WARM_[count] != (size_t)-1; ++count)
+        if (ircc_prefetch_kvs(&IRCC_RESOURCES_[IRCC_WARM_[count]]) < 0)
+            return -1;
+    return count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+)";
+    return compiled;
+}
+
+/// Start of huge payload section is aligned by an empty piece of it, so
+/// payloads inside need no padding
+std::string text_huge_functions()
+{
+    return R"(__asm__(".pushsection ircc_huge,\"a\"\n"
+        ".balign 2097152\n"
+        ".popsection\n");
+
+#ifdef __linux__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const char __start_ircc_huge[];
+extern const char __stop_ircc_huge[];
+
+/* pages moved to anonymous memory by ircc_huge_remap, set once; dropping
+   them would lose payloads instead of reading them again from the binary */
+static uintptr_t ircc_huge_begin_;
+static uintptr_t ircc_huge_end_;
+
+static int ircc_huge_remapped(const char *start, size_t length)
+{
+    uintptr_t end = __atomic_load_n(&ircc_huge_end_, __ATOMIC_ACQUIRE);
+    return end != 0 && (uintptr_t)start < end &&
+           (uintptr_t)start + length > ircc_huge_begin_;
+}
+
+/* Copies huge payloads to anonymous memory backed by transparent huge pages
+   and moves it over their original mapping. Returns count of remapped bytes
+   or -1. */
+long ircc_huge_remap(void)
+{
+    const size_t huge = 2 * 1024 * 1024;
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)__start_ircc_huge & ~(page - 1);
+    uintptr_t end = ((uintptr_t)__stop_ircc_huge + page - 1) & ~(page - 1);
+    size_t length = end - begin;
+    char *area;
+    char *copy;
+    if (length == 0)
+        return 0;
+
+    area = (char *)mmap(NULL,
+                        length + huge,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1,
+                        0);
+    if (area == MAP_FAILED)
+        return -1;
+    /* the same offset in huge page as the original, so huge pages stay
+       aligned after the move */
+    copy = area + ((begin - (uintptr_t)area) & (huge - 1));
+    madvise(copy, length, MADV_HUGEPAGE);
+    memcpy(copy, (const void *)begin, length);
+    if (mprotect(copy, length, PROT_READ) < 0 ||
+        mremap(copy,
+               length,
+               length,
+               MREMAP_MAYMOVE | MREMAP_FIXED,
+               (void *)begin) == MAP_FAILED)
+    {
+        munmap(area, length + huge);
+        return -1;
+    }
+    if (copy != area)
+        munmap(area, copy - area);
+    if (copy + length != area + length + huge)
+        munmap(copy + length, area + huge - copy);
+    ircc_huge_begin_ = begin;
+    __atomic_store_n(&ircc_huge_end_, end, __ATOMIC_RELEASE);
+    return (long)length;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+)";
+}
+
+std::string compile_interpose_map(
+    const std::vector<std::pair<std::string, std::string>> &prefixes)
+{
+    std::string compiled;
+    compiled += "static const char *const IRCC_INTERPOSE_[][2] = {\n";
+    for (auto &prefix : prefixes)
+        compiled +=
+            "\t{\"" + prefix.first + "\", \"" + prefix.second + "\"},\n";
+    compiled += "\t{NULL, NULL}};\n";
+    return compiled;
+}
+
+std::string text_interpose_functions()
+{
+    return R"(#ifdef __linux__
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+
+/* Maps path to resource with IRCC_INTERPOSE_ prefixes table */
+static struct key_value_size *ircc_interpose_lookup(const char *path)
+{
+    if (path == NULL)
+        return NULL;
+    for (int i = 0; IRCC_INTERPOSE_[i][0] != NULL; i++)
+    {
+        size_t len = strlen(IRCC_INTERPOSE_[i][0]);
+        if (strncmp(path, IRCC_INTERPOSE_[i][0], len) != 0)
+            continue;
+        char key[4096];
+        if (snprintf(key,
+                     sizeof(key),
+                     "%s%s",
+                     IRCC_INTERPOSE_[i][1],
+                     path + len) >= (int)sizeof(key))
+            continue;
+        struct key_value_size *kvs = ircc_binary_search(key);
+        if (kvs != NULL)
+            return kvs;
+    }
+    return NULL;
+}
+
+static void *ircc_real(void **cache, const char *name)
+{
+    void *fn = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+    if (fn == NULL)
+    {
+        fn = dlsym(RTLD_NEXT, name);
+        __atomic_store_n(cache, fn, __ATOMIC_RELEASE);
+    }
+    return fn;
+}
+
+typedef int (*ircc_open_fn)(const char *, int, ...);
+typedef int (*ircc_openat_fn)(int, const char *, int, ...);
+typedef FILE *(*ircc_fopen_fn)(const char *, const char *);
+static void *ircc_real_open_;
+static void *ircc_real_openat_;
+static void *ircc_real_fopen_;
+#ifdef __GLIBC__
+static void *ircc_real_open64_;
+static void *ircc_real_openat64_;
+static void *ircc_real_fopen64_;
+#endif
+
+/* Opens own description of the cached memfd, so every caller gets an
+   independent file offset */
+static int ircc_interpose_open(struct key_value_size *kvs, int flags)
+{
+    int fd = ircc_fd_by_kvs(kvs);
+    if (fd < 0)
+        return -1;
+    char procpath[64];
+    snprintf(procpath, sizeof(procpath), "/proc/self/fd/%d", fd);
+    ircc_open_fn real_open =
+        (ircc_open_fn)ircc_real(&ircc_real_open_, "open");
+    int newfd = real_open(procpath, O_RDONLY | (flags & O_CLOEXEC));
+    if (newfd < 0)
+        newfd = fcntl(fd, (flags & O_CLOEXEC) ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+    return newfd;
+}
+
+static int ircc_interpose_open_flags(const char *path, int flags)
+{
+    if ((flags & O_ACCMODE) != O_RDONLY ||
+        (flags & (O_CREAT | O_TRUNC | O_DIRECTORY)))
+        return -1;
+    struct key_value_size *kvs = ircc_interpose_lookup(path);
+    if (kvs == NULL)
+        return -1;
+    return ircc_interpose_open(kvs, flags);
+}
+
+static FILE *ircc_interpose_fopen(const char *path, const char *mode)
+{
+    if (mode == NULL || mode[0] != 'r' || strchr(mode, '+') != NULL)
+        return NULL;
+    struct key_value_size *kvs = ircc_interpose_lookup(path);
+    if (kvs == NULL)
+        return NULL;
+    int fd = ircc_interpose_open(kvs, strchr(mode, 'e') ? O_CLOEXEC : 0);
+    if (fd < 0)
+        return fmemopen((void *)kvs->value, kvs->size, "r");
+    FILE *file = fdopen(fd, "r");
+    if (file == NULL)
+        close(fd);
+    return file;
+}
+
+#define IRCC_FILL_STAT(buf, kvs)                                               \
+    do                                                                         \
+    {                                                                          \
+        memset((buf), 0, sizeof(*(buf)));                                      \
+        (buf)->st_mode = S_IFREG | 0444;                                       \
+        (buf)->st_nlink = 1;                                                   \
+        (buf)->st_ino = (kvs) - IRCC_RESOURCES_ + 1;                           \
+        (buf)->st_size = (kvs)->size;                                          \
+        (buf)->st_blksize = 4096;                                              \
+        (buf)->st_blocks = ((kvs)->size + 511) / 512;                          \
+    } while (0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    int fd = ircc_interpose_open_flags(path, flags);
+    if (fd >= 0)
+        return fd;
+    return ((ircc_open_fn)ircc_real(&ircc_real_open_, "open"))(
+        path, flags, mode);
+}
+
+/* paths relative to other directory than the current one are not mapped;
+   path is declared nonnull, which would drop the NULL check, but a NULL
+   path must reach libc and fail with EFAULT */
+static int ircc_interpose_at(int dirfd, const char *path)
+{
+    __asm__("" : "+r"(path));
+    return path != NULL && (dirfd == AT_FDCWD || path[0] == '/');
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    if (ircc_interpose_at(dirfd, path))
+    {
+        int fd = ircc_interpose_open_flags(path, flags);
+        if (fd >= 0)
+            return fd;
+    }
+    return ((ircc_openat_fn)ircc_real(&ircc_real_openat_, "openat"))(
+        dirfd, path, flags, mode);
+}
+
+/* 64-bit variants are separate symbols of glibc only, other libcs may
+   define them as macros of the plain ones */
+#ifdef __GLIBC__
+int open64(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    int fd = ircc_interpose_open_flags(path, flags);
+    if (fd >= 0)
+        return fd;
+    return ((ircc_open_fn)ircc_real(&ircc_real_open64_, "open64"))(
+        path, flags, mode);
+}
+
+int openat64(int dirfd, const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    if (ircc_interpose_at(dirfd, path))
+    {
+        int fd = ircc_interpose_open_flags(path, flags);
+        if (fd >= 0)
+            return fd;
+    }
+    return ((ircc_openat_fn)ircc_real(&ircc_real_openat64_, "openat64"))(
+        dirfd, path, flags, mode);
+}
+#endif
+
+FILE *fopen(const char *path, const char *mode)
+{
+    FILE *file = ircc_interpose_fopen(path, mode);
+    if (file != NULL)
+        return file;
+    return ((ircc_fopen_fn)ircc_real(&ircc_real_fopen_, "fopen"))(path, mode);
+}
+
+#ifdef __GLIBC__
+FILE *fopen64(const char *path, const char *mode)
+{
+    FILE *file = ircc_interpose_fopen(path, mode);
+    if (file != NULL)
+        return file;
+    return ((ircc_fopen_fn)ircc_real(&ircc_real_fopen64_, "fopen64"))(path,
+                                                                       mode);
+}
+#endif
+
+/* before glibc 2.33 stat is an inline wrapper around __xstat; other libcs
+   have no __GLIBC_PREREQ, which can not be used in one #if with defined */
+#ifdef __GLIBC_PREREQ
+#if !__GLIBC_PREREQ(2, 33)
+#define IRCC_XSTAT_
+#endif
+#endif
+
+#ifndef IRCC_XSTAT_
+typedef int (*ircc_stat_fn)(const char *, struct stat *);
+static void *ircc_real_stat_;
+
+int stat(const char *path, struct stat *buf)
+{
+    struct key_value_size *kvs = ircc_interpose_lookup(path);
+    if (kvs == NULL)
+        return ((ircc_stat_fn)ircc_real(&ircc_real_stat_, "stat"))(path, buf);
+    IRCC_FILL_STAT(buf, kvs);
+    return 0;
+}
+
+#ifdef __GLIBC__
+typedef int (*ircc_stat64_fn)(const char *, struct stat64 *);
+static void *ircc_real_stat64_;
+
+int stat64(const char *path, struct stat64 *buf)
+{
+    struct key_value_size *kvs = ircc_interpose_lookup(path);
+    if (kvs == NULL)
+        return ((ircc_stat64_fn)ircc_real(&ircc_real_stat64_, "stat64"))(path,
+                                                                         buf);
+    IRCC_FILL_STAT(buf, kvs);
+    return 0;
+}
+#endif
+#else
+typedef int (*ircc_xstat_fn)(int, const char *, struct stat *);
+typedef int (*ircc_xstat64_fn)(int, const char *, struct stat64 *);
+static void *ircc_real_xstat_;
+static void *ircc_real_xstat64_;
+
+int __xstat(int ver, const char *path, struct stat *buf)
+{
+    struct key_value_size *kvs = ircc_interpose_lookup(path);
+    if (kvs == NULL)
+        return ((ircc_xstat_fn)ircc_real(&ircc_real_xstat_, "__xstat"))(
+            ver, path, buf);
+    IRCC_FILL_STAT(buf, kvs);
+    return 0;
+}
+
+int __xstat64(int ver, const char *path, struct stat64 *buf)
+{
+    struct key_value_size *kvs = ircc_interpose_lookup(path);
+    if (kvs == NULL)
+        return ((ircc_xstat64_fn)ircc_real(&ircc_real_xstat64_, "__xstat64"))(
+            ver, path, buf);
+    IRCC_FILL_STAT(buf, kvs);
+    return 0;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+)";
+}
+
+struct VfsNode
+{
+    std::string name;
+    int parent;
+    int resource; //< index in IRCC_RESOURCES_ or -1 for directories
+    std::map<std::string, int> children;
+};
+
+std::vector<std::string> split_path(const std::string &path)
+{
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.size();
+        if (end != start)
+            components.push_back(path.substr(start, end - start));
+        start = end + 1;
+    }
+    return components;
+}
+
+/// Builds directory tree from keys splitted by '/' and lays it out in
+/// breadth-first order, so children of every directory are contiguous and
+/// sorted by name.
+std::string compile_vfs_tree(const std::vector<KeyBytes> &keybytes)
+{
+    std::vector<VfsNode> nodes = {VfsNode{"", 0, -1, {}}};
+    for (size_t i = 0; i < keybytes.size(); ++i)
+    {
+        auto components = split_path(keybytes[i].key);
+        if (components.empty())
+        {
+            std::cout << "Warning: key " << keybytes[i].key
+                      << " has no path components, skipped in vfs\n";
+            continue;
+        }
+
+        int current = 0;
+        bool conflict = false;
+        for (size_t c = 0; c < components.size() && !conflict; ++c)
+        {
+            bool last = c + 1 == components.size();
+            auto it = nodes[current].children.find(components[c]);
+            if (it == nodes[current].children.end())
+            {
+                int index = nodes.size();
+                nodes[current].children[components[c]] = index;
+                nodes.push_back(
+                    VfsNode{components[c], current, last ? (int)i : -1, {}});
+                current = index;
+            }
+            else if (last || nodes[it->second].resource != -1)
+                conflict = true;
+            else
+                current = it->second;
+        }
+        if (conflict)
+            std::cout << "Warning: key " << keybytes[i].key
+                      << " conflicts with another key, skipped in vfs\n";
+    }
+
+    std::vector<int> order = {0};
+    std::vector<int> new_index(nodes.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        new_index[order[i]] = i;
+        for (auto &child : nodes[order[i]].children)
+            order.push_back(child.second);
+    }
+
+    std::string compiled;
+    compiled += "static const struct ircc_vfs_node IRCC_VFS_[] = {\n";
+    int next_child = 1;
+    for (int index : order)
+    {
+        auto &node = nodes[index];
+        int first_child = node.children.empty() ? 0 : next_child;
+        next_child += node.children.size();
+        compiled += "\t{\"" + node.name + "\", ";
+        compiled += std::to_string(new_index[node.parent]) + ", ";
+        compiled += std::to_string(first_child) + ", ";
+        compiled += std::to_string(node.children.size()) + ", ";
+        compiled += std::to_string(node.resource) + "},\n";
+    }
+    compiled += "};\n";
+    return compiled;
+}
+
+std::string text_vfs_functions()
+{
+    return R"(#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ircc_stat
+{
+    size_t size;
+    int is_dir;
+    int ino;
+};
+
+struct ircc_dir
+{
+    int node;
+    int next;
+};
+
+struct ircc_dirent
+{
+    const char *name;
+    int is_dir;
+    int ino;
+};
+
+struct ircc_file
+{
+    const char *data;
+    size_t size;
+    size_t pos;
+};
+
+static int ircc_vfs_child(int dir, const char *name, size_t len)
+{
+    int low = IRCC_VFS_[dir].first_child;
+    int high = low + IRCC_VFS_[dir].child_count - 1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        int cmp = strncmp(name, IRCC_VFS_[mid].name, len);
+        if (cmp == 0 && IRCC_VFS_[mid].name[len] != '\0')
+            cmp = -1;
+        if (cmp < 0)
+            high = mid - 1;
+        else if (cmp > 0)
+            low = mid + 1;
+        else
+            return mid;
+    }
+    return -1;
+}
+
+static int ircc_vfs_resolve(const char *path)
+{
+    int node = 0;
+    while (*path != '\0')
+    {
+        const char *end = path;
+        while (*end != '\0' && *end != '/')
+            end++;
+        size_t len = end - path;
+        if (len == 0 || (len == 1 && path[0] == '.'))
+            ;
+        else if (IRCC_VFS_[node].resource != -1)
+            return -1;
+        else if (len == 2 && path[0] == '.' && path[1] == '.')
+            node = IRCC_VFS_[node].parent;
+        else if ((node = ircc_vfs_child(node, path, len)) < 0)
+            return -1;
+        path = *end == '/' ? end + 1 : end;
+    }
+    return node;
+}
+
+static size_t ircc_vfs_size(int node)
+{
+    if (IRCC_VFS_[node].resource == -1)
+        return IRCC_VFS_[node].child_count;
+    return IRCC_RESOURCES_[IRCC_VFS_[node].resource].size;
+}
+
+int ircc_stat(const char *path, struct ircc_stat *st)
+{
+    int node = ircc_vfs_resolve(path);
+    if (node < 0)
+        return -1;
+    st->size = ircc_vfs_size(node);
+    st->is_dir = IRCC_VFS_[node].resource == -1;
+    st->ino = node;
+    return 0;
+}
+
+int ircc_opendir(const char *path, struct ircc_dir *dir)
+{
+    int node = ircc_vfs_resolve(path);
+    if (node < 0 || IRCC_VFS_[node].resource != -1)
+        return -1;
+    dir->node = node;
+    dir->next = IRCC_VFS_[node].first_child;
+    return 0;
+}
+
+int ircc_readdir(struct ircc_dir *dir, struct ircc_dirent *ent)
+{
+    const struct ircc_vfs_node *parent = &IRCC_VFS_[dir->node];
+    if (dir->next >= parent->first_child + parent->child_count)
+        return 0;
+    ent->name = IRCC_VFS_[dir->next].name;
+    ent->is_dir = IRCC_VFS_[dir->next].resource == -1;
+    ent->ino = dir->next;
+    dir->next++;
+    return 1;
+}
+
+int ircc_open(const char *path, struct ircc_file *file)
+{
+    int node = ircc_vfs_resolve(path);
+    if (node < 0 || IRCC_VFS_[node].resource == -1)
+        return -1;
+    file->data = IRCC_RESOURCES_[IRCC_VFS_[node].resource].value;
+    file->size = IRCC_RESOURCES_[IRCC_VFS_[node].resource].size;
+    file->pos = 0;
+    return 0;
+}
+
+size_t ircc_read(struct ircc_file *file, void *buf, size_t size)
+{
+    size_t left = file->size - file->pos;
+    if (size > left)
+        size = left;
+    memcpy(buf, file->data + file->pos, size);
+    file->pos += size;
+    return size;
+}
+
+long ircc_seek(struct ircc_file *file, long offset, int whence)
+{
+    long base;
+    if (whence == SEEK_SET)
+        base = 0;
+    else if (whence == SEEK_CUR)
+        base = (long)file->pos;
+    else if (whence == SEEK_END)
+        base = (long)file->size;
+    else
+        return -1;
+    if (base + offset < 0 || base + offset > (long)file->size)
+        return -1;
+    file->pos = base + offset;
+    return (long)file->pos;
+}
+
+#ifdef __cplusplus
+}
+#endif
+)";
+}
+
+std::string text_struct_vfs_node()
+{
+    return R"(struct ircc_vfs_node
+{
+    const char *name;
+    int parent;
+    int first_child;
+    int child_count;
+    int resource;
+};
+)";
+}
+
+std::string text_cxx_functions()
+{
+    return R"(std::string ircc_string(const std::string& key)
+{
+    struct key_value_size *kvs = ircc_lookup(key.c_str());
+    if (kvs == NULL)
+        return {};
+    return std::string(kvs->value, kvs->size);
+}
+
+std::vector<uint8_t> ircc_vector(const std::string& key)
+{
+    struct key_value_size *kvs = ircc_lookup(key.c_str());
+    if (kvs == NULL)
+        return {};
+    return std::vector<uint8_t>((const uint8_t*)kvs->value, 
+                (const uint8_t*)(kvs->value + kvs->size));
+}
+
+std::pair<const char*, size_t> ircc_pair(const std::string& key)
+{
+    struct key_value_size *kvs = ircc_lookup(key.c_str());
+    if (kvs == NULL)
+        return {};
+    return std::pair<const char*, size_t>(kvs->value, kvs->size);
+}
+
+std::vector<std::string> ircc_keys()
+{
+    std::vector<std::string> list;
+    for (int i = 0; IRCC_RESOURCES_[i].key != NULL; i++)
+    {
+        list.push_back(IRCC_RESOURCES_[i].key);
+    }
+    return list;
+}
+)";
+}
+
+/// .ircpack layout: header, index sorted by key, NUL-terminated keys and
+/// payloads aligned to `align`, each followed by NUL byte.
+struct PackHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t index_offset;
+    uint64_t keys_offset;
+    uint64_t keys_size;
+    uint64_t file_size;
+    uint32_t align;
+    uint32_t reserved[3];
+};
+
+struct PackEntry
+{
+    uint64_t key_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t reserved;
+};
+
+const char PACK_MAGIC[8] = {'I', 'R', 'C', 'P', 'A', 'C', 'K', '\0'};
+const uint32_t PACK_VERSION = 1;
+
+uint64_t align_up(uint64_t value, uint64_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+void write_pack(const std::vector<KeyText> &texts,
+                const std::string &outfile,
+                uint32_t align)
+{
+    PackHeader header = {};
+    std::copy(PACK_MAGIC, PACK_MAGIC + 8, header.magic);
+    header.version = PACK_VERSION;
+    header.count = texts.size();
+    header.align = align;
+    header.index_offset = sizeof(PackHeader);
+    header.keys_offset =
+        header.index_offset + texts.size() * sizeof(PackEntry);
+
+    std::vector<PackEntry> index(texts.size());
+    uint64_t offset = header.keys_offset;
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        index[i].key_offset = offset;
+        offset += texts[i].key.size() + 1;
+    }
+    header.keys_size = offset - header.keys_offset;
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        offset = align_up(offset, align);
+        index[i].data_offset = offset;
+        index[i].data_size = texts[i].text.size();
+        offset += texts[i].text.size() + 1;
+    }
+    header.file_size = offset;
+
+    std::ofstream out(outfile, std::ios::binary);
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)index.data(), index.size() * sizeof(PackEntry));
+    for (auto &text : texts)
+        out.write(text.key.c_str(), text.key.size() + 1);
+    uint64_t written = header.keys_offset + header.keys_size;
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        std::string padding(index[i].data_offset - written, '\0');
+        out.write(padding.data(), padding.size());
+        out.write(texts[i].text.data(), texts[i].text.size());
+        out.put('\0');
+        written = index[i].data_offset + index[i].data_size + 1;
+    }
+}
+
+std::string text_pack_runtime()
+{
+    return R"(#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct ircc_pack_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t index_offset;
+    uint64_t keys_offset;
+    uint64_t keys_size;
+    uint64_t file_size;
+    uint32_t align;
+    uint32_t reserved[3];
+};
+
+struct ircc_pack_entry
+{
+    uint64_t key_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t reserved;
+};
+
+/* Pack descriptor: a mapped .ircpack file or a dlopen-ed generated table.
+   `state` counts pinned views in steps of 2, bit 0 marks a retired pack.
+   Descriptors are never freed, only the mapping or the module is released
+   once the pack is retired and unpinned, so a reader racing with a swap can
+   always touch `state` safely. */
+struct ircc_pack
+{
+    const char *base;
+    size_t size;
+    const struct ircc_pack_entry *index;
+    uint32_t count;
+    uint32_t state;
+    void *module;
+    const char *(*module_c_string)(const char *, size_t *);
+    const char *(*module_name_by_no)(size_t);
+};
+
+#define IRCC_PACK_RETIRED 1u
+#define IRCC_PACK_DEAD 0x80000001u
+
+static struct ircc_pack *ircc_pack_current;
+static __thread struct ircc_pack *ircc_pack_pinned;
+static pthread_key_t ircc_pack_pin_key;
+static pthread_once_t ircc_pack_pin_once = PTHREAD_ONCE_INIT;
+
+static void ircc_pack_reclaim(struct ircc_pack *pack)
+{
+    uint32_t expected = IRCC_PACK_RETIRED;
+    if (!__atomic_compare_exchange_n(&pack->state,
+                                     &expected,
+                                     IRCC_PACK_DEAD,
+                                     0,
+                                     __ATOMIC_ACQ_REL,
+                                     __ATOMIC_RELAXED))
+        return;
+    if (pack->module != NULL)
+        dlclose(pack->module);
+    else
+        munmap((void *)pack->base, pack->size);
+}
+
+#ifdef __cplusplus
+extern "C" void ircc_pack_release(const struct ircc_pack *view);
+#endif
+/* Unpins view obtained with ircc_pack_acquire */
+void ircc_pack_release(const struct ircc_pack *view)
+{
+    struct ircc_pack *pack = (struct ircc_pack *)view;
+    if (pack == NULL)
+        return;
+    if (__atomic_sub_fetch(&pack->state, 2, __ATOMIC_ACQ_REL) ==
+        IRCC_PACK_RETIRED)
+        ircc_pack_reclaim(pack);
+}
+
+#ifdef __cplusplus
+extern "C" const struct ircc_pack *ircc_pack_acquire(void);
+#endif
+/* Pins current pack. Data obtained through the view stays valid until
+   ircc_pack_release, even if another pack is published meanwhile. */
+const struct ircc_pack *ircc_pack_acquire(void)
+{
+    while (1)
+    {
+        struct ircc_pack *pack =
+            __atomic_load_n(&ircc_pack_current, __ATOMIC_ACQUIRE);
+        if (pack == NULL)
+            return NULL;
+        uint32_t state = __atomic_add_fetch(&pack->state, 2, __ATOMIC_ACQ_REL);
+        if ((state & IRCC_PACK_RETIRED) == 0)
+            return pack;
+        /* swapped out between load and pin, retry with the new one */
+        ircc_pack_release(pack);
+    }
+}
+
+static void ircc_pack_publish(struct ircc_pack *pack)
+{
+    struct ircc_pack *old =
+        __atomic_exchange_n(&ircc_pack_current, pack, __ATOMIC_ACQ_REL);
+    if (old != NULL &&
+        __atomic_or_fetch(&old->state, IRCC_PACK_RETIRED, __ATOMIC_ACQ_REL) ==
+            IRCC_PACK_RETIRED)
+        ircc_pack_reclaim(old);
+}
+
+#ifdef __cplusplus
+extern "C" int ircc_pack_open(const char *path);
+#endif
+/* Maps pack file and atomically makes it current. Only the header is
+   validated, so opening costs O(1) and payload pages are read lazily on
+   first access. The previous pack is unmapped when its last view is
+   released. */
+int ircc_pack_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        (size_t)st.st_size < sizeof(struct ircc_pack_header))
+    {
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+
+    const struct ircc_pack_header *header =
+        (const struct ircc_pack_header *)base;
+    const char *keys = (const char *)base + header->keys_offset;
+    size_t size = st.st_size;
+    if (memcmp(header->magic, "IRCPACK", 8) != 0 || header->version != 1 ||
+        header->file_size != size || header->index_offset > size ||
+        (size - header->index_offset) / sizeof(struct ircc_pack_entry) <
+            header->count ||
+        header->keys_offset > size ||
+        size - header->keys_offset < header->keys_size ||
+        (header->keys_size == 0 ? header->count != 0
+                                : keys[header->keys_size - 1] != '\0'))
+    {
+        munmap(base, size);
+        return -1;
+    }
+
+    struct ircc_pack *pack =
+        (struct ircc_pack *)calloc(1, sizeof(struct ircc_pack));
+    if (pack == NULL)
+    {
+        munmap(base, size);
+        return -1;
+    }
+    pack->base = (const char *)base;
+    pack->size = size;
+    pack->index = (const struct ircc_pack_entry *)((const char *)base +
+                                                   header->index_offset);
+    pack->count = header->count;
+    ircc_pack_publish(pack);
+    return 0;
+}
+
+#ifdef __cplusplus
+extern "C" int ircc_pack_open_module(const char *path);
+#endif
+/* Loads shared library built from a file generated by ircc and atomically
+   makes its table current. */
+int ircc_pack_open_module(const char *path)
+{
+    void *module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (module == NULL)
+        return -1;
+    struct ircc_pack *pack =
+        (struct ircc_pack *)calloc(1, sizeof(struct ircc_pack));
+    if (pack == NULL)
+    {
+        dlclose(module);
+        return -1;
+    }
+    pack->module = module;
+    *(void **)&pack->module_c_string = dlsym(module, "ircc_c_string");
+    *(void **)&pack->module_name_by_no = dlsym(module, "ircc_name_by_no");
+    if (pack->module_c_string == NULL || pack->module_name_by_no == NULL)
+    {
+        dlclose(module);
+        free(pack);
+        return -1;
+    }
+    while (pack->module_name_by_no(pack->count) != NULL)
+        pack->count++;
+    ircc_pack_publish(pack);
+    return 0;
+}
+
+static void ircc_pack_unpin(void *pack)
+{
+    ircc_pack_release((struct ircc_pack *)pack);
+}
+
+static void ircc_pack_make_pin_key(void)
+{
+    pthread_key_create(&ircc_pack_pin_key, ircc_pack_unpin);
+}
+
+#ifdef __cplusplus
+extern "C" void ircc_pack_quiescent(void);
+#endif
+/* Declares that the calling thread holds no pointers obtained by the plain
+   accessors, so its next lookup may switch to a newer pack. */
+void ircc_pack_quiescent(void)
+{
+    struct ircc_pack *pinned = ircc_pack_pinned;
+    if (pinned == NULL ||
+        pinned == __atomic_load_n(&ircc_pack_current, __ATOMIC_ACQUIRE))
+        return;
+    ircc_pack_pinned = NULL;
+    pthread_setspecific(ircc_pack_pin_key, NULL);
+    ircc_pack_release(pinned);
+}
+
+/* Pack used by the plain accessors of the calling thread. It stays pinned
+   until ircc_pack_quiescent or thread exit, so the lookup itself does not
+   touch shared memory. */
+static struct ircc_pack *ircc_pack_get(void)
+{
+    struct ircc_pack *pack = ircc_pack_pinned;
+    if (pack != NULL)
+        return pack;
+
+    if (__atomic_load_n(&ircc_pack_current, __ATOMIC_ACQUIRE) == NULL)
+    {
+        const char *path = getenv("IRCC_PACK");
+        if (path != NULL)
+            ircc_pack_open(path);
+    }
+    pack = (struct ircc_pack *)ircc_pack_acquire();
+    if (pack != NULL)
+    {
+        pthread_once(&ircc_pack_pin_once, ircc_pack_make_pin_key);
+        pthread_setspecific(ircc_pack_pin_key, pack);
+        ircc_pack_pinned = pack;
+    }
+    return pack;
+}
+
+static const struct ircc_pack_entry *
+ircc_pack_search(const struct ircc_pack *pack, const char *key)
+{
+    const struct ircc_pack_header *header =
+        (const struct ircc_pack_header *)pack->base;
+    uint64_t keys_end = header->keys_offset + header->keys_size;
+    int64_t low = 0;
+    int64_t high = (int64_t)pack->count - 1;
+    while (low <= high)
+    {
+        int64_t mid = (low + high) / 2;
+        const struct ircc_pack_entry *entry = &pack->index[mid];
+        if (entry->key_offset < header->keys_offset ||
+            entry->key_offset >= keys_end)
+            return NULL;
+        int cmp = strcmp(key, pack->base + entry->key_offset);
+        if (cmp < 0)
+            high = mid - 1;
+        else if (cmp > 0)
+            low = mid + 1;
+        else if (entry->data_offset > pack->size ||
+                 pack->size - entry->data_offset <= entry->data_size)
+            return NULL;
+        else
+            return entry;
+    }
+    return NULL;
+}
+
+#ifdef __cplusplus
+extern "C" const char *ircc_pack_c_string(const struct ircc_pack *view,
+                                          const char *key,
+                                          size_t *sizeptr);
+#endif
+/* Lookup in the view pinned with ircc_pack_acquire */
+const char *ircc_pack_c_string(const struct ircc_pack *view,
+                               const char *key,
+                               size_t *sizeptr)
+{
+    if (view == NULL)
+        return NULL;
+    if (view->module != NULL)
+        return view->module_c_string(key, sizeptr);
+    const struct ircc_pack_entry *entry = ircc_pack_search(view, key);
+    if (entry == NULL)
+        return NULL;
+    if (sizeptr != NULL)
+        *sizeptr = entry->data_size;
+    return view->base + entry->data_offset;
+}
+
+#ifdef __cplusplus
+extern "C" const char *ircc_c_string(const char *key, size_t *sizeptr);
+#endif
+const char *ircc_c_string(const char *key, size_t *sizeptr)
+{
+    return ircc_pack_c_string(ircc_pack_get(), key, sizeptr);
+}
+
+#ifdef __cplusplus
+extern "C" const char *ircc_name_by_no(size_t no);
+#endif
+const char *ircc_name_by_no(size_t no)
+{
+    struct ircc_pack *pack = ircc_pack_get();
+    if (pack == NULL || no >= pack->count)
+        return NULL;
+    if (pack->module != NULL)
+        return pack->module_name_by_no(no);
+    const struct ircc_pack_header *header =
+        (const struct ircc_pack_header *)pack->base;
+    if (pack->index[no].key_offset < header->keys_offset ||
+        pack->index[no].key_offset >= header->keys_offset + header->keys_size)
+        return NULL;
+    return pack->base + pack->index[no].key_offset;
+}
+)";
+}
+
+std::string text_pack_cxx_functions()
+{
+    return R"(std::string ircc_string(const std::string& key)
+{
+    size_t size;
+    const char *value = ircc_c_string(key.c_str(), &size);
+    if (value == NULL)
+        return {};
+    return std::string(value, size);
+}
+
+std::vector<uint8_t> ircc_vector(const std::string& key)
+{
+    size_t size;
+    const char *value = ircc_c_string(key.c_str(), &size);
+    if (value == NULL)
+        return {};
+    return std::vector<uint8_t>((const uint8_t*)value,
+                (const uint8_t*)(value + size));
+}
+
+std::pair<const char*, size_t> ircc_pair(const std::string& key)
+{
+    size_t size;
+    const char *value = ircc_c_string(key.c_str(), &size);
+    if (value == NULL)
+        return {};
+    return std::pair<const char*, size_t>(value, size);
+}
+
+std::vector<std::string> ircc_keys()
+{
+    std::vector<std::string> list;
+    const char *key;
+    for (size_t i = 0; (key = ircc_name_by_no(i)) != NULL; i++)
+    {
+        list.push_back(key);
+    }
+    return list;
+}
+)";
+}
+
+bool is_rebuild_needed(std::vector<KeySource> keysources, std::string outfile)
+{
+    if (!std::filesystem::exists(outfile))
+        return true;
+    if (keysources.size() == 0)
+        return false;
+    /// outfile modification time
+    std::filesystem::file_time_type outfile_mtime =
+        std::filesystem::last_write_time(outfile);
+
+    for (auto keysource : keysources)
+    {
+        if (std::filesystem::last_write_time(keysource.source) > outfile_mtime)
+            return true;
+    }
+    return false;
+}
+
+struct GeneratorOptions
+{
+    bool cpp_enabled = true;
+    bool vfs_enabled = false;
+    bool dev_enabled = false;
+    bool incbin_enabled = false;
+    bool counters_enabled = false;
+    bool bloom_enabled = false;
+    size_t shards = 1;
+    uint64_t huge_threshold = 0; // < payloads from this size are huge
+    std::string cache_dir; // < results of transform stages
+    std::map<std::string, size_t> profile; // < ranks of hot keys
+    std::vector<std::pair<std::string, std::string>> interpose_prefixes;
+};
+
+/// Composes the whole generated source file
+std::string compile_output(const std::vector<KeySource> &sources,
+                           const std::vector<KeyBytes> &keybytes,
+                           const PayloadLayout &layout,
+                           const GeneratorOptions &options)
+{
+    std::string out;
+    out += compile_headers(options.cpp_enabled,
+                           !options.interpose_prefixes.empty());
+    out += "\n";
+    if (options.incbin_enabled || options.shards > 1)
+    {
+        out += text_payload_linkage();
+        out += "\n";
+    }
+    if (options.huge_threshold != 0)
+    {
+        out += text_huge_functions();
+        out += "\n";
+    }
+    out += compile_ircc_resources_consts(keybytes, layout);
+    out += text_struct_key_value_size();
+    out += "\n";
+    out += compile_ircc_resources_map_cstyle(keybytes, layout);
+    out += "\n";
+    if (options.counters_enabled)
+    {
+        out += text_counters_functions();
+        out += "\n";
+    }
+    if (options.bloom_enabled)
+    {
+        out += compile_bloom_filter(keybytes);
+        out += "\n";
+    }
+    out += text_binary_search_function(options.counters_enabled,
+                                       options.bloom_enabled);
+    out += "\n";
+    if (options.dev_enabled)
+        out += text_dev_lookup_function(sources);
+    else
+        out += text_lookup_function();
+    out += "\n";
+    out += text_c_functions();
+    out += "\n";
+    out += text_fd_functions();
+    out += "\n";
+    out += text_residency_functions(options.huge_threshold != 0);
+    out += "\n";
+    out += compile_warm(sources);
+
+    if (options.vfs_enabled)
+    {
+        out += "\n";
+        out += text_struct_vfs_node();
+        out += "\n";
+        out += compile_vfs_tree(keybytes);
+        out += "\n";
+        out += text_vfs_functions();
+    }
+
+    if (!options.interpose_prefixes.empty())
+    {
+        out += "\n";
+        out += compile_interpose_map(options.interpose_prefixes);
+        out += "\n";
+        out += text_interpose_functions();
+    }
+
+    if (options.cpp_enabled)
+    {
+        out += "\n";
+        out += text_cxx_functions();
+    }
+    return out;
+}
+
+/// Reads, transforms and encodes one resource for generated source
+KeyBytes keysource_to_keybytes(const KeySource &source,
+                               const GeneratorOptions &options)
+{
+    if (options.incbin_enabled)
+        return keysource_to_incbin(source, options.cache_dir);
+    auto keytext = keysource_to_keytext(source);
+    if (!source.transforms.empty())
+    {
+        std::filesystem::create_directories(options.cache_dir);
+        transform_resource(source, keytext.text, options.cache_dir);
+    }
+    return keytext_to_keybytes(keytext);
+}
+
+std::vector<KeyBytes> keysources_to_keybytes(
+    const std::vector<KeySource> &sources, const GeneratorOptions &options)
+{
+    std::vector<KeyBytes> keybytes(sources.size());
+    parallel_for(sources.size(),
+                 [&](size_t i)
+                 { keybytes[i] = keysource_to_keybytes(sources[i], options); });
+    return keybytes;
+}
+
+/// Composes all generated files: the main one first, then shards. Paths are
+/// paired with texts.
+std::vector<std::pair<std::string, std::string>>
+compile_outputs(const std::string &outfile,
+                const std::vector<KeySource> &sources,
+                const std::vector<KeyBytes> &keybytes,
+                const GeneratorOptions &options)
+{
+    auto layout = layout_payloads(
+        keybytes, options.shards, options.profile, options.huge_threshold);
+    std::vector<std::pair<std::string, std::string>> outputs;
+    outputs.emplace_back(outfile,
+                         compile_output(sources, keybytes, layout, options));
+    for (size_t shard = 0; options.shards > 1 && shard < options.shards;
+         ++shard)
+        outputs.emplace_back(shard_path(outfile, shard),
+                             compile_shard(keybytes, layout, shard));
+    return outputs;
+}
+
+/// Paths of all files written for outfile
+std::vector<std::string> output_paths(const std::string &outfile,
+                                      const GeneratorOptions &options)
+{
+    std::vector<std::string> paths = {outfile};
+    for (size_t shard = 0; options.shards > 1 && shard < options.shards;
+         ++shard)
+        paths.push_back(shard_path(outfile, shard));
+    return paths;
+}
+
+/// Sizes of one resource or of group of resources. `raw` is size of source
+/// files before transforms, `encoded` is size in binary, `generated` is size
+/// of generated source.
+struct SizeEntry
+{
+    std::string name;
+    std::string source;
+    size_t count = 0;
+    uint64_t raw = 0;
+    uint64_t encoded = 0;
+    uint64_t generated = 0;
+};
+
+/// Composition of generated code. Index counts key strings and lookup table
+/// in binary and everything except payloads in generated sources.
+struct SizeReport
+{
+    std::vector<SizeEntry> resources;
+    std::vector<SizeEntry> prefixes;
+    SizeEntry index;
+    SizeEntry total;
+};
+
+SizeReport make_size_report(
+    const std::vector<KeySource> &sources,
+    const std::vector<KeyBytes> &keybytes,
+    const std::vector<std::pair<std::string, std::string>> &outputs,
+    const GeneratorOptions &options)
+{
+    SizeReport report;
+    auto layout = layout_payloads(
+        keybytes, options.shards, options.profile, options.huge_threshold);
+    std::map<std::string, SizeEntry> prefixes;
+    report.index.name = "(index)";
+    report.total.name = "(total)";
+    for (size_t i = 0; i < keybytes.size(); ++i)
+    {
+        SizeEntry entry;
+        entry.name = keybytes[i].key;
+        entry.source = sources[i].source;
+        entry.count = 1;
+        entry.raw = sources[i].data ? sources[i].data->size()
+                                    : std::filesystem::file_size(
+                                          sources[i].source);
+        entry.encoded = keybytes[i].size + 1;
+        entry.generated = compile_payload(keybytes[i],
+                                          layout.names[i],
+                                          options.shards > 1,
+                                          layout.huge[i])
+                              .size();
+
+        // every directory prefix of key accumulates its resources
+        for (size_t slash = entry.name.find('/'); slash != std::string::npos;
+             slash = entry.name.find('/', slash + 1))
+        {
+            auto &prefix = prefixes[entry.name.substr(0, slash + 1)];
+            prefix.count++;
+            prefix.raw += entry.raw;
+            prefix.encoded += entry.encoded;
+            prefix.generated += entry.generated;
+        }
+
+        report.index.encoded += keybytes[i].key.size() + 1;
+        report.total.count++;
+        report.total.raw += entry.raw;
+        report.total.encoded += entry.encoded;
+        report.total.generated += entry.generated;
+        report.resources.push_back(entry);
+    }
+    for (auto &prefix : prefixes)
     {
-        compiled +=
-            "const char* const IRCC_RESOURCES_" + std::to_string(i) + " = \n";
-        compiled += keybytes_to_keybytesdivided(keybytes[i], 2).bytes_divided;
-        compiled += ";\n\n";
+        report.prefixes.push_back(prefix.second);
+        report.prefixes.back().name = prefix.first;
     }
-    return compiled;
-}
 
-std::string compile_ircc_resources_map_cstyle(std::vector<KeyBytes> keybytes)
-{
+    report.index.count = keybytes.size();
+    report.index.encoded +=
+        (keybytes.size() + 1) * (2 * sizeof(void *) + sizeof(size_t));
+    for (auto &output : outputs)
+        report.index.generated += output.second.size();
+    report.index.generated -= report.total.generated;
+    report.total.encoded += report.index.encoded;
+    report.total.generated += report.index.generated;
 
-    std::string compiled = "";
-    compiled += "struct key_value_size IRCC_RESOURCES_[] = {\n";
-    for (size_t i = 0; i < keybytes.size(); ++i)
+    auto larger = [](const SizeEntry &a, const SizeEntry &b)
     {
-        compiled += "\t{\"" + keybytes[i].key + "\", ";
-        compiled += "IRCC_RESOURCES_" + std::to_string(i);
-        compiled += ", ";
-        compiled += std::to_string(keybytes[i].bytes.size() / 4);
-        compiled += "},\n";
-    }
-    compiled += "\t{NULL, NULL, 0}};\n";
-    return compiled;
+        return a.encoded != b.encoded ? a.encoded > b.encoded
+                                      : a.name < b.name;
+    };
+    std::sort(report.resources.begin(), report.resources.end(), larger);
+    std::sort(report.prefixes.begin(), report.prefixes.end(), larger);
+    return report;
 }
 
-std::string text_struct_key_value_size()
-{
-    return R"(struct key_value_size
+/// Prints resources and prefixes sorted by size in binary
+void print_size_report(const SizeReport &report, std::ostream &out)
 {
-    const char *key;
-    const char *value;
-    size_t size;
-};
-)";
+    int width = 24;
+    for (auto &entry : report.resources)
+        width = std::max(width, std::min(64, (int)entry.name.size()));
+
+    char line[256];
+    auto print = [&](const SizeEntry &entry)
+    {
+        snprintf(line,
+                 sizeof(line),
+                 "%-*s %6zu %12llu %12llu %12llu\n",
+                 width,
+                 entry.name.c_str(),
+                 entry.count,
+                 (unsigned long long)entry.raw,
+                 (unsigned long long)entry.encoded,
+                 (unsigned long long)entry.generated);
+        out << line;
+    };
+    snprintf(line,
+             sizeof(line),
+             "%-*s %6s %12s %12s %12s\n",
+             width,
+             "resource",
+             "count",
+             "raw",
+             "encoded",
+             "generated");
+    out << line;
+    for (auto &entry : report.resources)
+        print(entry);
+    out << "\n";
+    snprintf(line,
+             sizeof(line),
+             "%-*s %6s %12s %12s %12s\n",
+             width,
+             "prefix",
+             "count",
+             "raw",
+             "encoded",
+             "generated");
+    out << line;
+    for (auto &entry : report.prefixes)
+        print(entry);
+    out << "\n";
+    print(report.index);
+    print(report.total);
 }
 
-std::string text_binary_search_function()
+void write_size_report(const SizeReport &report, const std::string &path)
 {
-    return R"(struct key_value_size *ircc_binary_search(const char *key)
-{
-    int low = 0;
-    int high = sizeof(IRCC_RESOURCES_) / sizeof(IRCC_RESOURCES_[0]) - 1;
-    int mid;
-    while (low <= high)
+    auto sizes = [](const SizeEntry &entry)
     {
-        mid = (low + high) / 2;
-        int cmp = strcmp(key, IRCC_RESOURCES_[mid].key);
-        if (cmp < 0)
-            high = mid - 1;
-        else if (cmp > 0)
-            low = mid + 1;
-        else
-            return &IRCC_RESOURCES_[mid];
+        return "\"count\": " + std::to_string(entry.count) +
+               ", \"raw\": " + std::to_string(entry.raw) +
+               ", \"encoded\": " + std::to_string(entry.encoded) +
+               ", \"generated\": " + std::to_string(entry.generated);
+    };
+
+    std::ofstream out(path);
+    out << "{\n  \"resources\": [";
+    for (size_t i = 0; i < report.resources.size(); ++i)
+    {
+        auto &entry = report.resources[i];
+        out << (i ? ",\n" : "\n") << "    {\"key\": \""
+            << json_escape(entry.name) << "\", \"source\": \""
+            << json_escape(entry.source) << "\", " << sizes(entry) << "}";
     }
-    return NULL;
-}
-)";
+    out << "\n  ],\n  \"prefixes\": [";
+    for (size_t i = 0; i < report.prefixes.size(); ++i)
+    {
+        auto &entry = report.prefixes[i];
+        out << (i ? ",\n" : "\n") << "    {\"prefix\": \""
+            << json_escape(entry.name) << "\", " << sizes(entry) << "}";
+    }
+    out << "\n  ],\n";
+    out << "  \"index\": {" << sizes(report.index) << "},\n";
+    out << "  \"total\": {" << sizes(report.total) << "}\n";
+    out << "}\n";
 }
 
-std::string text_c_functions()
-{
-    return R"(#ifdef __cplusplus
-extern "C" const char *ircc_c_string(const char *key, size_t *sizeptr);
-#endif
-const char *ircc_c_string(const char *key, size_t *sizeptr)
+/// Prints every exceeded limit, zero limit is not checked. Returns count of
+/// exceeded limits.
+size_t check_budgets(const SizeReport &report,
+                     uint64_t total_budget,
+                     uint64_t resource_budget)
 {
-    struct key_value_size *kvs = ircc_binary_search(key);
-    if (kvs == NULL)
-        return NULL;
-    if (sizeptr != NULL)
-        *sizeptr = kvs->size;
-    return kvs->value;
+    size_t exceeded = 0;
+    for (auto &entry : report.resources)
+    {
+        if (resource_budget == 0 || entry.encoded <= resource_budget)
+            continue;
+        std::cout << "Budget: resource " << entry.name << " takes "
+                  << entry.encoded << " bytes, limit is " << resource_budget
+                  << std::endl;
+        exceeded++;
+    }
+    if (total_budget != 0 && report.total.encoded > total_budget)
+    {
+        std::cout << "Budget: resources take " << report.total.encoded
+                  << " bytes, limit is " << total_budget << std::endl;
+        exceeded++;
+    }
+    return exceeded;
 }
 
-#ifdef __cplusplus
-extern "C" const char *ircc_name_by_no(size_t no);
-#endif
-const char *ircc_name_by_no(size_t no)
+/// Parses byte count with optional K, M or G suffix (powers of 1024)
+bool parse_size(const std::string &text, uint64_t &size)
 {
-    return IRCC_RESOURCES_[no].key;
-}
-)";
+    char *end = nullptr;
+    size = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str())
+        return false;
+    std::string suffix = end;
+    if (suffix == "K" || suffix == "k")
+        size <<= 10;
+    else if (suffix == "M" || suffix == "m")
+        size <<= 20;
+    else if (suffix == "G" || suffix == "g")
+        size <<= 30;
+    else if (!suffix.empty())
+        return false;
+    return true;
 }
 
-std::string text_cxx_functions()
+std::string normal_path(const std::string &path)
 {
-    return R"(std::string ircc_string(const std::string& key)
-{
-    struct key_value_size *kvs = ircc_binary_search(key.c_str());
-    if (kvs == NULL)
-        return {};
-    return std::string(kvs->value, kvs->size);
+    return std::filesystem::path(path).lexically_normal().string();
 }
 
-std::vector<uint8_t> ircc_vector(const std::string& key)
+std::string parent_directory(const std::string &path)
 {
-    struct key_value_size *kvs = ircc_binary_search(key.c_str());
-    if (kvs == NULL)
-        return {};
-    return std::vector<uint8_t>((const uint8_t*)kvs->value, 
-                (const uint8_t*)(kvs->value + kvs->size));
+    auto parent = std::filesystem::path(path).parent_path().string();
+    return parent.empty() ? "." : parent;
 }
 
-std::pair<const char*, size_t> ircc_pair(const std::string& key)
+/// Keeps output current: regenerates it on inotify events in directories of
+/// the listfile, of the profile and of all sources. Only changed files are
+/// encoded again, output is rewritten only if its text changes. A missing
+/// listfile is waited for.
+int watch_loop(const std::string &listfile,
+               const std::string &ignorefile,
+               const std::string &profile,
+               const std::string &outfile,
+               GeneratorOptions options)
 {
-    struct key_value_size *kvs = ircc_binary_search(key.c_str());
-    if (kvs == NULL)
-        return {};
-    return std::pair<const char*, size_t>(kvs->value, kvs->size);
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0)
+    {
+        perror("inotify_init1");
+        return 1;
+    }
+    const uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE |
+                          IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_DELETE_SELF | IN_MOVE_SELF;
+
+    std::map<int, std::string> watched; // wd -> directory
+    // normal path (and \0 member of archive) -> transforms and payload
+    std::map<std::string, std::pair<std::vector<std::string>, KeyBytes>>
+        encoded;
+    std::set<std::string> scanned;              // directory syntax entries
+    std::set<std::string> known;                // listfile and sources
+    std::set<std::string> touched;
+    std::vector<KeySource> sources;
+    bool listed = false;
+    bool rescan = true;
+
+    while (true)
+    {
+        if (!profile.empty() &&
+            (rescan || touched.count(normal_path(profile)) != 0))
+        {
+            try
+            {
+                options.profile = read_profile(profile);
+            }
+            catch (const std::runtime_error &e)
+            {
+                // the previous profile is kept until the file is readable
+                std::cout << "ircc: " << e.what() << std::endl;
+            }
+        }
+
+        if (rescan)
+        {
+            // the directory of the listfile is watched even if it is
+            // missing, so its creation is seen
+            std::vector<std::string> directories;
+            listed = std::filesystem::exists(listfile);
+            if (!listed)
+            {
+                std::cout << "ircc: waiting for " << listfile << std::endl;
+                sources.clear();
+            }
+            else
+            {
+                try
+                {
+                    sources = get_sources_from_file(
+                        listfile, &directories, ignorefile);
+                }
+                catch (const std::runtime_error &e)
+                {
+                    // a directory or an archive changed during the scan,
+                    // next event retries
+                    std::cout << "ircc: " << e.what() << std::endl;
+                }
+            }
+            sort_sources(sources);
+
+            scanned.clear();
+            known = {normal_path(listfile), normal_path(ignorefile)};
+            if (!profile.empty())
+                known.insert(normal_path(profile));
+            for (auto &directory : directories)
+                scanned.insert(normal_path(directory));
+            for (auto &source : sources)
+                known.insert(normal_path(source.source));
+
+            std::set<std::string> wanted = scanned;
+            for (auto &path : known)
+                wanted.insert(parent_directory(path));
+
+            std::map<int, std::string> updated;
+            for (auto &directory : wanted)
+            {
+                int wd = inotify_add_watch(inotify_fd, directory.c_str(), mask);
+                if (wd >= 0)
+                    updated[wd] = directory;
+            }
+            for (auto &[wd, directory] : watched)
+                if (updated.count(wd) == 0)
+                    inotify_rm_watch(inotify_fd, wd);
+            watched = updated;
+            rescan = false;
+        }
+
+        for (auto &path : touched)
+            encoded.erase(encoded.lower_bound(path),
+                          encoded.lower_bound(path + '\x01'));
+        touched.clear();
+
+        if (!rescan && listed && check_exists(sources) == 0)
+        {
+            size_t reencoded = 0;
+            std::vector<KeyBytes> keybytes;
+            try
+            {
+                for (auto &source : sources)
+                {
+                    auto path = normal_path(source.source);
+                    if (!source.member.empty())
+                        path += '\0' + source.member;
+                    auto it = encoded.find(path);
+                    if (it != encoded.end() &&
+                        it->second.first != source.transforms)
+                    {
+                        encoded.erase(it);
+                        it = encoded.end();
+                    }
+                    if (it == encoded.end())
+                    {
+                        auto bytes = keysource_to_keybytes(source, options);
+                        it = encoded
+                                 .emplace(path,
+                                          std::make_pair(source.transforms,
+                                                         bytes))
+                                 .first;
+                        reencoded++;
+                    }
+                    keybytes.push_back(it->second.second);
+                    keybytes.back().key = source.key;
+                }
+                for (auto &[path, text] :
+                     compile_outputs(outfile, sources, keybytes, options))
+                    write_file_if_changed(path, text);
+                std::cout << "ircc: " << outfile << " is up to date, "
+                          << reencoded << " of " << sources.size()
+                          << " resources encoded" << std::endl;
+            }
+            catch (const std::runtime_error &e)
+            {
+                std::cout << "ircc: " << e.what() << std::endl;
+            }
+        }
+
+        // wait for relevant events, then collect the burst which usually
+        // follows
+        char buf[65536]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+        struct pollfd pfd = {inotify_fd, POLLIN, 0};
+        int timeout = -1;
+        while (poll(&pfd, 1, timeout) > 0 || (!rescan && touched.empty()))
+        {
+            ssize_t len = read(inotify_fd, buf, sizeof(buf));
+            if (len <= 0)
+                break;
+            for (char *ptr = buf; ptr < buf + len;)
+            {
+                auto event = (struct inotify_event *)ptr;
+                ptr += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    rescan = true;
+                    encoded.clear();
+                    continue;
+                }
+                auto it = watched.find(event->wd);
+                if (it == watched.end())
+                    continue;
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                {
+                    rescan = true;
+                    continue;
+                }
+                auto path = normal_path(it->second + "/" + event->name);
+                if (known.count(path) == 0 && scanned.count(it->second) == 0)
+                    continue;
+                touched.insert(path);
+                if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO) ||
+                    is_archive(path) ||
+                    path == normal_path(listfile) ||
+                    path == normal_path(ignorefile))
+                    rescan = true;
+            }
+            if (rescan || !touched.empty())
+                timeout = 50;
+        }
+    }
 }
 
-std::vector<std::string> ircc_keys()
+/// Escapes path for Makefile/Ninja depfile
+std::string depfile_escape(const std::string &path)
 {
-    std::vector<std::string> list;
-    for (int i = 0; IRCC_RESOURCES_[i].key != NULL; i++)
+    std::string escaped;
+    for (char c : path)
     {
-        list.push_back(IRCC_RESOURCES_[i].key);
+        if (c == ' ' || c == '#' || c == '\\')
+            escaped += '\\';
+        if (c == '$')
+            escaped += '$';
+        escaped += c;
     }
-    return list;
-}
-)";
+    return escaped;
 }
 
-bool is_rebuild_needed(std::vector<KeySource> keysources, std::string outfile)
+/// Writes Makefile rule with listfile, ignore file, all sources and all
+/// scanned directories as prerequisites of outputs. Directories are listed,
+/// so adding a file to directory syntax entry changes their mtime and causes
+/// rebuild.
+void write_depfile(const std::string &depfile,
+                   const std::vector<std::string> &outfiles,
+                   const std::string &listfile,
+                   const std::string &ignorefile,
+                   const std::string &profile,
+                   const std::vector<KeySource> &sources,
+                   const std::vector<std::string> &directories)
 {
-    if (!std::filesystem::exists(outfile))
-        return true;
-    if (keysources.size() == 0)
-        return false;
-    /// outfile modification time
-    std::filesystem::file_time_type outfile_mtime =
-        std::filesystem::last_write_time(outfile);
+    std::vector<std::string> deps = {listfile};
+    if (std::filesystem::exists(ignorefile))
+        deps.push_back(ignorefile);
+    if (!profile.empty())
+        deps.push_back(profile);
+    for (auto &directory : directories)
+        deps.push_back(directory);
+    for (auto &source : sources)
+        deps.push_back(source.source);
 
-    for (auto keysource : keysources)
+    std::set<std::string> written;
+    std::ofstream out(depfile);
+    for (size_t i = 0; i < outfiles.size(); ++i)
+        out << (i ? " " : "") << depfile_escape(outfiles[i]);
+    out << ":";
+    for (auto &dep : deps)
     {
-        if (std::filesystem::last_write_time(keysource.source) > outfile_mtime)
-            return true;
+        auto path = std::filesystem::absolute(dep).lexically_normal().string();
+        if (!written.insert(path).second)
+            continue;
+        out << " \\\n  " << depfile_escape(path);
     }
-    return false;
+    out << "\n";
 }
 
 void print_help()
@@ -393,6 +4580,45 @@ void print_help()
     std::cout << "Options:\n";
     std::cout << "\t-h, --help\tShow this help\n";
     std::cout << "\t-c, --c_only\tMake C file instead C++\n";
+    std::cout << "\t--vfs\tadd directory tree and ircc_stat/ircc_opendir/"
+                 "ircc_open api\n";
+    std::cout << "\t--interpose PATH_PREFIX=KEY_PREFIX\tserve open/fopen/stat "
+                 "calls for paths under PATH_PREFIX from resources\n";
+    std::cout << "\t--dev\trecord source paths, so debug builds serve "
+                 "resources from disk when IRCC_DEV=1 is set\n";
+    std::cout << "\t--pack\twrite resources to mmap-able .ircpack file "
+                 "instead of source\n";
+    std::cout << "\t--pack-align N\talignment of payloads in pack "
+                 "(default 64)\n";
+    std::cout << "\t--pack-runtime\tgenerate source which serves accessors "
+                 "from .ircpack file (input file is not needed)\n";
+    std::cout << "\t--incbin\tinclude payloads with assembler .incbin "
+                 "instead of string literals\n";
+    std::cout << "\t--shards N\tsplit payloads to N files OUT.shardK.EXT, "
+                 "which can be compiled in parallel\n";
+    std::cout << "\t--counters\tcount hits and bytes served of every "
+                 "resource, see ircc_stats_dump\n";
+    std::cout << "\t--bloom\treject most lookups of missing keys by a Bloom "
+                 "filter before the binary search\n";
+    std::cout << "\t--profile FILE\temit payloads of keys listed in FILE "
+                 "first, hot first (list of keys or ircc_stats_dump output)"
+                 "\n";
+    std::cout << "\t--huge-threshold SIZE\tplace payloads of SIZE and "
+                 "larger to 2 MB aligned section, see ircc_huge_remap\n";
+    std::cout << "\t--ignore-file FILE\tglob patterns excluded from all "
+                 "directory entries (default .irccignore next to listfile)\n";
+    std::cout << "\t--cache-dir DIR\tstore results of transform stages in "
+                 "DIR (default .ircc-cache next to output)\n";
+    std::cout << "\t--stats\tprint time, bytes and throughput of every stage "
+                 "and peak memory\n";
+    std::cout << "\t--report FILE\tprint resources and key prefixes sorted "
+                 "by size, write the same report as json to FILE\n";
+    std::cout << "\t--budget-total SIZE\tfail before writing output if "
+                 "resources and index take more than SIZE (K, M, G)\n";
+    std::cout << "\t--budget-resource SIZE\tfail before writing output if "
+                 "any resource takes more than SIZE\n";
+    std::cout << "\t--trace FILE\twrite spans of stages and resources in "
+                 "Chrome trace event format\n";
     std::cout << "For build systems compatible:\n";
     std::cout << "\t-s, --sources\tprint list of resourse pathes\n";
     std::cout << "\t-S, --sources-cmake\tprint list of resourse pathes in "
@@ -400,16 +4626,56 @@ void print_help()
     std::cout << "\t-k, --keys\tprint list of keys\n";
     std::cout << "\t-n, --is-rebuild-needed\tprint yes if rebuild needed. "
                  "Otherwise print no.\n";
+    std::cout << "\t-d, --depfile FILE\twrite Makefile/Ninja depfile with "
+                 "listfile, sources and scanned directories\n";
+    std::cout << "\t-w, --watch\tstay running and regenerate output when "
+                 "listfile or sources change\n";
 }
 
+/// Values of long options without short equivalent
+enum
+{
+    OPT_VFS = 256,
+    OPT_INTERPOSE,
+    OPT_PACK,
+    OPT_PACK_ALIGN,
+    OPT_PACK_RUNTIME,
+    OPT_DEV,
+    OPT_INCBIN,
+    OPT_SHARDS,
+    OPT_IGNORE_FILE,
+    OPT_CACHE_DIR,
+    OPT_STATS,
+    OPT_TRACE,
+    OPT_REPORT,
+    OPT_BUDGET_TOTAL,
+    OPT_BUDGET_RESOURCE,
+    OPT_COUNTERS,
+    OPT_BLOOM,
+    OPT_PROFILE,
+    OPT_HUGE_THRESHOLD,
+};
+
 int main(int argc, char **argv)
 {
-    bool CPP_ENABLED = true;
+    GeneratorOptions options;
     bool PRINT_KEYS_MODE = false;
     bool PRINT_SOURCES_MODE = false;
     bool PRINT_SOURCES_CMAKE_MODE = false;
     bool IS_REBUILD_NEEDED_MODE = false;
+    bool WATCH_MODE = false;
+    bool PACK_MODE = false;
+    bool PACK_RUNTIME_MODE = false;
+    uint32_t PACK_ALIGN = 64;
     std::string OUTFILE = {};
+    std::string DEPFILE = {};
+    std::string IGNORE_FILE = {};
+    bool STATS_MODE = false;
+    std::string TRACE_FILE = {};
+    std::string REPORT_FILE = {};
+    std::string PROFILE_FILE = {};
+    uint64_t BUDGET_TOTAL = 0;
+    uint64_t BUDGET_RESOURCE = 0;
 
     const struct option long_options[] = {
         {"help", no_argument, NULL, 'h'},
@@ -419,13 +4685,35 @@ int main(int argc, char **argv)
         {"sources-cmake", no_argument, NULL, 'S'},
         {"is-rebuild-needed", no_argument, NULL, 'n'},
         {"keys", no_argument, NULL, 'k'},
+        {"watch", no_argument, NULL, 'w'},
+        {"depfile", required_argument, NULL, 'd'},
+        {"vfs", no_argument, NULL, OPT_VFS},
+        {"dev", no_argument, NULL, OPT_DEV},
+        {"interpose", required_argument, NULL, OPT_INTERPOSE},
+        {"pack", no_argument, NULL, OPT_PACK},
+        {"pack-align", required_argument, NULL, OPT_PACK_ALIGN},
+        {"pack-runtime", no_argument, NULL, OPT_PACK_RUNTIME},
+        {"incbin", no_argument, NULL, OPT_INCBIN},
+        {"shards", required_argument, NULL, OPT_SHARDS},
+        {"ignore-file", required_argument, NULL, OPT_IGNORE_FILE},
+        {"cache-dir", required_argument, NULL, OPT_CACHE_DIR},
+        {"stats", no_argument, NULL, OPT_STATS},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {"report", required_argument, NULL, OPT_REPORT},
+        {"budget-total", required_argument, NULL, OPT_BUDGET_TOTAL},
+        {"budget-resource", required_argument, NULL, OPT_BUDGET_RESOURCE},
+        {"counters", no_argument, NULL, OPT_COUNTERS},
+        {"bloom", no_argument, NULL, OPT_BLOOM},
+        {"profile", required_argument, NULL, OPT_PROFILE},
+        {"huge-threshold", required_argument, NULL, OPT_HUGE_THRESHOLD},
+        {NULL, 0, NULL, 0},
     };
 
     int long_index = 0;
     int opt = 0;
 
     while ((opt = getopt_long(
-                argc, argv, "hco:ksS", long_options, &long_index)) != -1)
+                argc, argv, "hco:ksSnwd:", long_options, &long_index)) != -1)
     {
         switch (opt)
         {
@@ -434,7 +4722,7 @@ int main(int argc, char **argv)
             exit(0);
 
         case 'c':
-            CPP_ENABLED = false;
+            options.cpp_enabled = false;
             break;
 
         case 'o':
@@ -457,6 +4745,134 @@ int main(int argc, char **argv)
             IS_REBUILD_NEEDED_MODE = true;
             break;
 
+        case 'w':
+            WATCH_MODE = true;
+            break;
+
+        case 'd':
+            DEPFILE = optarg;
+            break;
+
+        case OPT_VFS:
+            options.vfs_enabled = true;
+            break;
+
+        case OPT_INTERPOSE:
+        {
+            std::string mapping = optarg;
+            auto eq = mapping.find('=');
+            if (eq == std::string::npos)
+            {
+                std::cout << "Interpose mapping must be PATH_PREFIX=KEY_PREFIX"
+                          << std::endl;
+                exit(-1);
+            }
+            options.interpose_prefixes.emplace_back(mapping.substr(0, eq),
+                                                    mapping.substr(eq + 1));
+            break;
+        }
+
+        case OPT_DEV:
+            options.dev_enabled = true;
+            break;
+
+        case OPT_PACK:
+            PACK_MODE = true;
+            break;
+
+        case OPT_PACK_ALIGN:
+        {
+            uint64_t align;
+            if (!parse_decimal(optarg, align) || align == 0 ||
+                align > UINT32_MAX || (align & (align - 1)) != 0)
+            {
+                std::cout << "Pack alignment must be a positive power of two"
+                          << std::endl;
+                exit(-1);
+            }
+            PACK_ALIGN = align;
+            break;
+        }
+
+        case OPT_PACK_RUNTIME:
+            PACK_RUNTIME_MODE = true;
+            break;
+
+        case OPT_INCBIN:
+            options.incbin_enabled = true;
+            break;
+
+        case OPT_SHARDS:
+        {
+            uint64_t shards;
+            if (!parse_decimal(optarg, shards) || shards == 0)
+            {
+                std::cout << "Shards count must be a positive number"
+                          << std::endl;
+                exit(-1);
+            }
+            options.shards = shards;
+            break;
+        }
+
+        case OPT_IGNORE_FILE:
+            IGNORE_FILE = optarg;
+            break;
+
+        case OPT_CACHE_DIR:
+            options.cache_dir = optarg;
+            break;
+
+        case OPT_STATS:
+            STATS_MODE = true;
+            break;
+
+        case OPT_TRACE:
+            TRACE_FILE = optarg;
+            break;
+
+        case OPT_COUNTERS:
+            options.counters_enabled = true;
+            break;
+
+        case OPT_BLOOM:
+            options.bloom_enabled = true;
+            break;
+
+        case OPT_PROFILE:
+            PROFILE_FILE = optarg;
+            break;
+
+        case OPT_HUGE_THRESHOLD:
+            if (!parse_size(optarg, options.huge_threshold) ||
+                options.huge_threshold == 0)
+            {
+                std::cout << "Huge threshold must be a positive size with "
+                             "optional K, M or G suffix"
+                          << std::endl;
+                exit(-1);
+            }
+            break;
+
+        case OPT_REPORT:
+            REPORT_FILE = optarg;
+            break;
+
+        case OPT_BUDGET_TOTAL:
+        case OPT_BUDGET_RESOURCE:
+        {
+            uint64_t &budget =
+                opt == OPT_BUDGET_TOTAL ? BUDGET_TOTAL : BUDGET_RESOURCE;
+            if (!parse_size(optarg, budget))
+            {
+                std::cout << "Budget must be a size in bytes with optional "
+                             "K, M or G suffix"
+                          << std::endl;
+                exit(-1);
+            }
+            break;
+        }
+
         case '?':
             exit(-1);
             break;
@@ -468,6 +4884,25 @@ int main(int argc, char **argv)
         }
     };
 
+    if (PACK_RUNTIME_MODE)
+    {
+        if (OUTFILE.empty())
+        {
+            std::cout << "Output file is needed. Use -o option.\n";
+            exit(-1);
+        }
+        std::ofstream out(OUTFILE);
+        out << compile_headers(options.cpp_enabled, false);
+        out << "\n";
+        out << text_pack_runtime();
+        if (options.cpp_enabled)
+        {
+            out << "\n";
+            out << text_pack_cxx_functions();
+        }
+        return 0;
+    }
+
     if (optind >= argc)
     {
         std::cout << "No input file\n";
@@ -482,17 +4917,84 @@ int main(int argc, char **argv)
         exit(-1);
     }
 
+    if (PACK_MODE &&
+        (!REPORT_FILE.empty() || BUDGET_TOTAL != 0 || BUDGET_RESOURCE != 0))
+    {
+        std::cout << "--report and budgets are not supported with --pack\n";
+        exit(-1);
+    }
+
+    if (WATCH_MODE && (PACK_MODE || !DEPFILE.empty() || STATS_MODE ||
+                       !TRACE_FILE.empty() || !REPORT_FILE.empty() ||
+                       BUDGET_TOTAL != 0 || BUDGET_RESOURCE != 0))
+    {
+        std::cout << "--pack, --depfile, --stats, --trace, --report and "
+                     "budgets are not supported with --watch\n";
+        exit(-1);
+    }
+
     std::string listfile = argv[optind];
-    auto sources = get_sources_from_file(listfile);
+    if (IGNORE_FILE.empty())
+        IGNORE_FILE = default_ignore_file(listfile);
+    if (options.cache_dir.empty())
+        options.cache_dir =
+            (std::filesystem::path(OUTFILE).parent_path() / ".ircc-cache")
+                .string();
+
+    if (!PROFILE_FILE.empty())
+    {
+        try
+        {
+            options.profile = read_profile(PROFILE_FILE);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cout << "Fatal: " << e.what() << std::endl;
+            exit(1);
+        }
+    }
+
+    if (WATCH_MODE)
+        return watch_loop(
+            listfile, IGNORE_FILE, PROFILE_FILE, OUTFILE, options);
+
+    PROFILER.enabled = STATS_MODE || !TRACE_FILE.empty();
+    auto report = [&]()
+    {
+        if (STATS_MODE)
+            print_stats(std::cout);
+        if (!TRACE_FILE.empty())
+            write_trace(TRACE_FILE);
+    };
+
+    std::vector<std::string> directories;
+    std::vector<KeySource> sources;
+    try
+    {
+        ProfileSpan span("parse", listfile);
+        sources = get_sources_from_file(listfile, &directories, IGNORE_FILE);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << "Fatal: " << e.what() << std::endl;
+        exit(1);
+    }
 
-    int errors = check_exists(sources);
+    int errors;
+    {
+        ProfileSpan span("check");
+        errors = check_exists(sources);
+    }
     if (errors > 0)
     {
         std::cout << "Fatal: " << errors << " errors occurred." << std::endl;
         exit(1);
     }
 
-    sort_sources(sources);
+    {
+        ProfileSpan span("sort");
+        sort_sources(sources);
+    }
 
     if (IS_REBUILD_NEEDED_MODE)
     {
@@ -530,25 +5032,92 @@ int main(int argc, char **argv)
         exit(0);
     }
 
-    auto texts = keysources_to_keytexts(sources);
-    auto keybytes = keytexts_to_keybytes(texts);
-    std::ofstream out(OUTFILE);
-    out << compile_headers(CPP_ENABLED);
-    out << "\n";
-    out << compile_ircc_resources_consts(keybytes);
-    out << text_struct_key_value_size();
-    out << "\n";
-    out << compile_ircc_resources_map_cstyle(keybytes);
-    out << "\n";
-    out << text_binary_search_function();
-    out << "\n";
-    out << text_c_functions();
+    // written with outputs, so a failed budget leaves no depfile behind
+    auto depfile = [&]()
+    {
+        if (!DEPFILE.empty())
+            write_depfile(DEPFILE,
+                          output_paths(OUTFILE, options),
+                          listfile,
+                          IGNORE_FILE,
+                          PROFILE_FILE,
+                          sources,
+                          directories);
+    };
+
+    std::vector<KeyBytes> keybytes;
 
-    if (CPP_ENABLED)
+    try
     {
-        out << "\n";
-        out << text_cxx_functions();
+        if (PACK_MODE)
+        {
+            std::vector<KeyText> keytexts;
+            {
+                ProfileSpan span("load");
+                keytexts = load_keytexts(sources, options.cache_dir);
+                for (auto &keytext : keytexts)
+                    span.add_bytes(keytext.text.size());
+            }
+            depfile();
+            {
+                ProfileSpan span("write", OUTFILE);
+                write_pack(keytexts, OUTFILE, PACK_ALIGN);
+                span.add_bytes(std::filesystem::file_size(OUTFILE));
+            }
+            report();
+            return 0;
+        }
+        ProfileSpan span("load");
+        keybytes = keysources_to_keybytes(sources, options);
+        for (auto &resource : keybytes)
+            span.add_bytes(resource.size);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << "Fatal: " << e.what() << std::endl;
+        exit(1);
+    }
+
+    // main output is always written, so its mtime satisfies make; shards
+    // keep their mtime when unchanged and are not recompiled
+    std::vector<std::pair<std::string, std::string>> outputs;
+    {
+        ProfileSpan span("compile");
+        outputs = compile_outputs(OUTFILE, sources, keybytes, options);
+        for (auto &output : outputs)
+            span.add_bytes(output.second.size());
+    }
+
+    if (!REPORT_FILE.empty() || BUDGET_TOTAL != 0 || BUDGET_RESOURCE != 0)
+    {
+        auto sizes = make_size_report(sources, keybytes, outputs, options);
+        if (!REPORT_FILE.empty())
+        {
+            print_size_report(sizes, std::cout);
+            write_size_report(sizes, REPORT_FILE);
+        }
+        size_t exceeded = check_budgets(sizes, BUDGET_TOTAL, BUDGET_RESOURCE);
+        if (exceeded > 0)
+        {
+            // a failure of generation, as other fatal errors; wrong options
+            // exit with -1
+            std::cout << "Fatal: " << exceeded << " budgets exceeded."
+                      << std::endl;
+            exit(1);
+        }
+    }
+
+    depfile();
+    {
+        ProfileSpan span("write", OUTFILE);
+        std::ofstream out(outputs[0].first);
+        out << outputs[0].second;
+        out.close();
+        for (size_t i = 1; i < outputs.size(); ++i)
+            write_file_if_changed(outputs[i].first, outputs[i].second);
+        for (auto &output : outputs)
+            span.add_bytes(output.second.size());
     }
-    out.close();
+    report();
     return 0;
 }
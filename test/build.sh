@@ -1,5 +1,57 @@
 set +o xtrace
-ircc resources.txt -o ircc_resources.gen.cpp
-ircc resources.txt -o ircc_resources.gen.c --c_only 
-g++ -o runtest1 main.cpp ircc_resources.gen.cpp -I . -g
-gcc -o runtest2 main.c ircc_resources.gen.c -I . -g
\ No newline at end of file
+ircc resources.txt -o ircc_resources.gen.cpp --vfs --interpose /ircc-test/=/ --profile profile.txt --huge-threshold 16K
+ircc resources.txt -o ircc_resources.gen.c --c_only --vfs --interpose /ircc-test/=/
+g++ -o runtest1 main.cpp ircc_resources.gen.cpp -I . -g -DIRCC_TEST_PROFILE -DIRCC_TEST_HUGE
+gcc -o runtest2 main.c ircc_resources.gen.c -I . -g
+ircc resources.txt -o ircc_sharded.gen.cpp --shards 3 --incbin --vfs --interpose /ircc-test/=/ --counters --bloom
+g++ -o runtest3 main.cpp ircc_sharded.gen*.cpp -I . -g -DIRCC_TEST_COUNTERS -DIRCC_TEST_BLOOM
+ircc resources.txt -o resources.ircpack --pack
+ircc --pack-runtime -o ircc_pack.gen.cpp
+ircc resources.txt -o ircc_module.gen.c --c_only
+gcc -shared -fPIC -o libresources_module.so ircc_module.gen.c
+g++ -o packtest pack.cpp ircc_pack.gen.cpp -I . -g -ldl -pthread \
+    -DIRCC_TEST_PACK=\"resources.ircpack\" \
+    -DIRCC_TEST_MODULE=\"./libresources_module.so\"
+mkdir -p dev && cp helloworld.txt dev/hello.txt && cp config.json dev/
+(cd dev && ircc ../dev.txt -o ../ircc_dev.gen.cpp --dev)
+g++ -o devtest dev.cpp ircc_dev.gen.cpp -I . -g \
+    -DIRCC_TEST_DEV=\"$PWD/dev/hello.txt\"
+g++ -o devtest_ndebug dev.cpp ircc_dev.gen.cpp -I . -g -DNDEBUG \
+    -DIRCC_TEST_DEV=\"$PWD/dev/hello.txt\"
+# generation fails on an archive which ends inside member data
+echo "/tar/ ./tar_truncated.tar" > truncated.txt
+if ircc truncated.txt -o ircc_truncated.gen.cpp; then
+    echo "Truncated archive accepted"
+    exit 1
+fi
+# watch mode waits for a missing listfile, then follows edits of sources and
+# of the profile
+rm -rf watch && mkdir watch && cd watch
+printf HelloWorld > hello.txt
+printf HelloUnderWorld > foo.txt
+printf '/foo\n/hello\n' > profile.txt
+ircc resources.txt -o ircc_watch.gen.cpp --watch --profile profile.txt &
+WATCH=$!
+wait_for()
+{
+    for i in $(seq 100); do
+        grep -qF "$1" ircc_watch.gen.cpp 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo "Watch mode missed: $1"
+    kill $WATCH
+    exit 1
+}
+sleep 0.5
+printf '/hello ./hello.txt\n/foo ./foo.txt\n' > resources.txt
+wait_for '{"/foo", (IRCC_BLOB_ + 0), 15}'
+printf Hi > hello.txt
+wait_for '{"/hello", (IRCC_BLOB_ + 16), 2}'
+printf '/hello\n/foo\n' > profile.txt
+wait_for '{"/hello", (IRCC_BLOB_ + 0), 2}'
+kill $WATCH
+cd ..
+if ircc resources.txt -o ircc_watch.gen.cpp --watch --depfile watch.d; then
+    echo "Depfile accepted with --watch"
+    exit 1
+fi
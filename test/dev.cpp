@@ -0,0 +1,61 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <ircc/ircc.h>
+#include <ircc/ircc_json.h>
+#include <string>
+
+// copy of helloworld.txt listed by dev.txt
+static const std::string HELLO = IRCC_TEST_DEV;
+
+static void write_file(const std::string &path, const std::string &text)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+TEST_CASE("dev overlay")
+{
+    setenv("IRCC_DEV", "1", 1);
+    CHECK_EQ(ircc_string("/hello"), "HelloWorld");
+    CHECK_EQ(ircc_c_string("zzz", NULL), nullptr);
+
+    write_file(HELLO, "HelloEdit");
+#ifdef NDEBUG
+    // overlay is compiled out, the embedded resource is served
+    CHECK_EQ(ircc_string("/hello"), "HelloWorld");
+#else
+    CHECK_EQ(ircc_string("/hello"), "HelloEdit");
+    // earlier pointers stay valid
+    const char *edit = ircc_c_string("/hello", NULL);
+    write_file(HELLO, "HelloAgain");
+    CHECK_EQ(ircc_string("/hello"), "HelloAgain");
+    CHECK_EQ(std::string(edit), "HelloEdit");
+
+    // editor saves by renaming the original to a backup, later edits of
+    // the new file are seen too
+    REQUIRE_EQ(rename(HELLO.c_str(), (HELLO + "~").c_str()), 0);
+    write_file(HELLO, "HelloSaved");
+    CHECK_EQ(ircc_string("/hello"), "HelloSaved");
+    write_file(HELLO, "HelloLater");
+    CHECK_EQ(ircc_string("/hello"), "HelloLater");
+    std::remove((HELLO + "~").c_str());
+
+    // unreadable source falls back to the embedded resource
+    std::remove(HELLO.c_str());
+    CHECK_EQ(ircc_string("/hello"), "HelloWorld");
+#endif
+    write_file(HELLO, "HelloWorld");
+}
+
+TEST_CASE("dev transforms")
+{
+    // transformed resources are served from the build, not the source
+    setenv("IRCC_DEV", "1", 1);
+    auto config = ircc_json::resource("/config");
+    REQUIRE_EQ(config.type(), ircc_json::TYPE_OBJECT);
+    CHECK_EQ(config["name"].as_string(), "ircc");
+}
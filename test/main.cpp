@@ -1,10 +1,18 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <iostream>
 #include <map>
 #include <string>
+#include <thread>
 #include <ircc/ircc.h>
+#include <ircc/ircc_json.h>
 
 TEST_CASE("c_string")
 {
@@ -79,4 +87,280 @@ TEST_CASE("directory syntax")
     }
 
     CHECK_NE(resource, nullptr);
-}
\ No newline at end of file
+}
+
+TEST_CASE("missing key")
+{
+    CHECK_EQ(ircc_c_string("zzz", NULL), nullptr);
+    CHECK_EQ(ircc_c_string("", NULL), nullptr);
+    CHECK_EQ(ircc_pair("/web/missing.html").first, nullptr);
+}
+
+TEST_CASE("transforms")
+{
+    CHECK_EQ(std::string(ircc_c_string("/web/functions.json", NULL)),
+             "{\"name\":\"ircc\",\"keys\":[1,2]}");
+    CHECK_EQ(std::string(ircc_c_string("/web/index.html", NULL)),
+             "<HTML>\n<BODY> HI </BODY>\n</HTML>");
+}
+
+TEST_CASE("json binary")
+{
+    auto config = ircc_json::resource("/config");
+    REQUIRE_EQ(config.type(), ircc_json::TYPE_OBJECT);
+    CHECK_EQ(config.size(), 6);
+    CHECK_EQ(config.key(0), "debug");
+    CHECK_EQ(config["name"].as_string(), "ircc");
+    CHECK_EQ(config["port"].as_int(), 8080);
+    CHECK_EQ(config["ratio"].as_double(), 0.5);
+    CHECK_EQ(config["debug"].as_bool(true), false);
+    CHECK_EQ(config["tags"].size(), 5);
+    CHECK_EQ(config["tags"].at(1).as_string(), "b\xc3\xa9");
+    // surrogate pair, unpaired surrogates become U+FFFD
+    CHECK_EQ(config["tags"].at(2).as_string(), "\xf0\x9f\x98\x80");
+    CHECK_EQ(config["tags"].at(3).as_string(), "\xef\xbf\xbdx");
+    CHECK_EQ(config["tags"].at(4).as_string(),
+             "\xef\xbf\xbd" "A" "\xef\xbf\xbd");
+    CHECK_EQ(config["limits"]["files"].as_int(), 300000);
+    CHECK(config["limits"]["depth"].is_null());
+    CHECK_FALSE(config["missing"]);
+    CHECK_FALSE(config["tags"].at(5));
+    CHECK_EQ(config["name"]["x"].as_string("default"), "default");
+    CHECK_FALSE(ircc_json::resource("/hello"));
+
+    // root offset is little endian on every host
+    auto [data, size] = ircc_pair("/config");
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t root = bytes[4] | bytes[5] << 8 | bytes[6] << 16 |
+                    (uint32_t)bytes[7] << 24;
+    REQUIRE_LT(root, size);
+    CHECK_EQ(bytes[root], ircc_json::TYPE_OBJECT);
+}
+
+TEST_CASE("archive")
+{
+    CHECK_EQ(ircc_string("/tar/readme.txt"), "from tar\n");
+    CHECK_EQ(ircc_string("/tar/nested/data.txt"), "nested\n");
+    // excluded by .irccignore
+    CHECK_EQ(ircc_c_string("/tar/nested/data.txt~", NULL), nullptr);
+}
+
+TEST_CASE("archive formats")
+{
+    // paths longer than 100 bytes: ustar prefix, GNU L/K and pax records;
+    // hard links get data of their targets
+    std::string dir = "long/";
+    for (int i = 0; i < 12; ++i)
+        dir += "d123456789/";
+    CHECK_EQ(ircc_string("/tar/ustar/a.txt"), "ustar\n");
+    CHECK_EQ(ircc_string(("/tar/ustar/" + dir + "b.txt").c_str()), "ustar\n");
+    CHECK_EQ(ircc_string(("/tar/gnu/" + dir + "data.txt").c_str()), "gnu\n");
+    CHECK_EQ(ircc_string("/tar/gnu/zlink.txt"), "gnu\n");
+    CHECK_EQ(ircc_string(("/tar/pax/" + dir + "data.txt").c_str()), "pax\n");
+    CHECK_EQ(ircc_string("/tar/pax/zlink.txt"), "pax\n");
+}
+
+TEST_CASE("filters")
+{
+    // excluded by --exclude=fixtures and by *~ in .irccignore
+    CHECK_EQ(ircc_c_string("/web/fixtures/data.txt", NULL), nullptr);
+    CHECK_EQ(ircc_c_string("/web/index.html~", NULL), nullptr);
+}
+
+TEST_CASE("residency")
+{
+    struct ircc_residency res;
+    CHECK_EQ(ircc_residency("missing", &res), -1);
+    REQUIRE_EQ(ircc_residency("/image", &res), 0);
+    CHECK_EQ(res.size, 38905);
+    CHECK_GE(res.pages, 38905 / (size_t)sysconf(_SC_PAGESIZE));
+
+    std::string image = ircc_string("/image");
+    REQUIRE_EQ(ircc_residency("/image", &res), 0);
+    CHECK_EQ(res.resident, res.pages);
+
+    // dropped pages are read again from the binary
+    CHECK_EQ(ircc_drop("/image"), 0);
+    CHECK_EQ(ircc_string("/image"), image);
+    CHECK_EQ(ircc_drop("missing"), -1);
+}
+
+TEST_CASE("prefetch")
+{
+    CHECK_EQ(ircc_prefetch("/image"), 0);
+    CHECK_EQ(ircc_prefetch("missing"), -1);
+    CHECK_EQ(ircc_prefetch_prefix("/tar/"), 8);
+    CHECK_EQ(ircc_prefetch_prefix("/web/index"), 1);
+    CHECK_EQ(ircc_prefetch_prefix("/zzz"), 0);
+    CHECK_EQ(ircc_prefetch_prefix(""), 14);
+    CHECK_EQ(ircc_prefetch_warm(), 1); // /hello
+}
+
+#ifdef IRCC_TEST_HUGE
+TEST_CASE("huge remap")
+{
+    // built with --huge-threshold 16K, only /image is huge
+    std::string image = ircc_string("/image");
+    const char *data = ircc_c_string("/image", NULL);
+    CHECK_EQ((uintptr_t)data % 64, 0);
+    CHECK_GE(ircc_huge_remap(), 38905);
+    CHECK_EQ(ircc_c_string("/image", NULL), data);
+    CHECK_EQ(ircc_string("/image"), image);
+    // anonymous copy can not be read again from the binary
+    CHECK_EQ(ircc_drop("/image"), -1);
+    CHECK_EQ(ircc_string("/image"), image);
+    CHECK_EQ(ircc_string("/hello"), "HelloWorld");
+}
+#endif
+
+#ifdef IRCC_TEST_PROFILE
+TEST_CASE("profile order")
+{
+    // profile.txt: /web/index.html, /hello, the rest in key order
+    const char *index = ircc_c_string("/web/index.html", NULL);
+    const char *hello = ircc_c_string("/hello", NULL);
+    const char *image = ircc_c_string("/image", NULL);
+    CHECK_LT(index, hello);
+    CHECK_LT(hello, image);
+    CHECK_EQ(ircc_string("/hello"), "HelloWorld");
+}
+#endif
+
+#ifdef IRCC_TEST_COUNTERS
+TEST_CASE("counters")
+{
+    size_t no = 0;
+    while (strcmp(ircc_name_by_no(no), "/hello") != 0)
+        no++;
+    struct ircc_resource_stats before, after;
+    REQUIRE_EQ(ircc_stats_get(no, &before), 0);
+
+    for (int i = 0; i < 3; ++i)
+        ircc_c_string("/hello", NULL);
+    // later threads take over the block of the first one, counts included
+    for (int i = 0; i < 3; ++i)
+        std::thread([] { ircc_string("/hello"); }).join();
+
+    REQUIRE_EQ(ircc_stats_get(no, &after), 0);
+    CHECK_EQ(after.hits - before.hits, 6);
+    CHECK_EQ(after.bytes - before.bytes, 60);
+    CHECK_EQ(ircc_stats_get(1000, &after), -1);
+
+    char buf[4096] = {};
+    FILE *file = fmemopen(buf, sizeof(buf) - 1, "w");
+    ircc_stats_dump(file);
+    fclose(file);
+    std::string line = "/hello " + std::to_string(after.hits) + " " +
+                       std::to_string(after.bytes) + "\n";
+    CHECK_NE(std::string(buf).find(line), std::string::npos);
+}
+#endif
+
+#ifdef IRCC_TEST_BLOOM
+TEST_CASE("bloom")
+{
+    for (size_t no = 0; ircc_name_by_no(no) != NULL; ++no)
+        CHECK_NE(ircc_c_string(ircc_name_by_no(no), NULL), nullptr);
+    CHECK_EQ(ircc_c_string("/hello.map", NULL), nullptr);
+    CHECK_EQ(ircc_c_string("/hellp", NULL), nullptr);
+    CHECK_EQ(ircc_c_string("", NULL), nullptr);
+}
+#endif
+
+TEST_CASE("fd")
+{
+    int fd = ircc_fd("another_key");
+    REQUIRE_GE(fd, 0);
+    CHECK_EQ(ircc_fd("another_key"), fd);
+    CHECK_EQ(ircc_fd("missing"), -1);
+
+    char buf[32] = {};
+    CHECK_EQ(pread(fd, buf, sizeof(buf), 0), 15);
+    CHECK_EQ(strcmp("HelloUnderWorld", buf), 0);
+    CHECK_EQ(lseek(fd, 0, SEEK_END), 15);
+    CHECK_NE(fcntl(fd, F_GET_SEALS) & F_SEAL_WRITE, 0);
+    CHECK_EQ(pwrite(fd, "x", 1, 0), -1);
+}
+
+TEST_CASE("vfs stat")
+{
+    struct ircc_stat st;
+    REQUIRE_EQ(ircc_stat("/web", &st), 0);
+    CHECK(st.is_dir);
+    CHECK_EQ(st.size, 2);
+    REQUIRE_EQ(ircc_stat("another_key", &st), 0);
+    CHECK_FALSE(st.is_dir);
+    CHECK_EQ(st.size, 15);
+    CHECK_EQ(ircc_stat("/web/./../web//index.html", &st), 0);
+    CHECK_EQ(ircc_stat("/web/missing", &st), -1);
+    CHECK_EQ(ircc_stat("/hello/x", &st), -1);
+}
+
+TEST_CASE("vfs readdir")
+{
+    struct ircc_dir dir;
+    struct ircc_dirent ent;
+    std::vector<std::string> names;
+    REQUIRE_EQ(ircc_opendir("/", &dir), 0);
+    while (ircc_readdir(&dir, &ent))
+        names.push_back(ent.name);
+    CHECK_EQ(names,
+             std::vector<std::string>{
+                 "another_key", "config", "hello", "image", "tar", "web"});
+    CHECK_EQ(ircc_opendir("/hello", &dir), -1);
+}
+
+TEST_CASE("vfs read")
+{
+    struct ircc_file file;
+    char buf[8] = {};
+    REQUIRE_EQ(ircc_open("/hello", &file), 0);
+    CHECK_EQ(ircc_read(&file, buf, 5), 5);
+    CHECK_EQ(std::string(buf), "Hello");
+    CHECK_EQ(ircc_seek(&file, -5, SEEK_END), 5);
+    CHECK_EQ(ircc_read(&file, buf, sizeof(buf)), 5);
+    CHECK_EQ(std::string(buf, 5), "World");
+    CHECK_EQ(ircc_seek(&file, 1, SEEK_END), -1);
+    CHECK_EQ(ircc_open("/web", &file), -1);
+}
+
+TEST_CASE("interpose")
+{
+    char buf[32] = {};
+    int fd = open("/ircc-test/hello", O_RDONLY);
+    REQUIRE_GE(fd, 0);
+    CHECK_EQ(read(fd, buf, sizeof(buf)), 10);
+    CHECK_EQ(std::string(buf), "HelloWorld");
+    close(fd);
+
+    FILE *file = fopen("/ircc-test/web/index.html", "r");
+    REQUIRE_NE(file, nullptr);
+    fclose(file);
+
+    struct stat st;
+    REQUIRE_EQ(stat("/ircc-test/image", &st), 0);
+    CHECK_EQ(st.st_size, 38905);
+    CHECK(S_ISREG(st.st_mode));
+
+    std::ifstream stream("/ircc-test/hello");
+    std::string text;
+    stream >> text;
+    CHECK_EQ(text, "HelloWorld");
+
+    fd = openat(AT_FDCWD, "/ircc-test/hello", O_RDONLY);
+    REQUIRE_GE(fd, 0);
+    CHECK_EQ(read(fd, buf, sizeof(buf)), 10);
+    close(fd);
+
+    // NULL path fails in libc, the interposer does not crash on it
+    int dir = open("/", O_RDONLY | O_DIRECTORY);
+    REQUIRE_GE(dir, 0);
+    const char *volatile none = nullptr;
+    errno = 0;
+    CHECK_EQ(openat(dir, none, O_RDONLY), -1);
+    CHECK_EQ(errno, EFAULT);
+    close(dir);
+
+    CHECK_EQ(open("/ircc-test/missing", O_RDONLY), -1);
+    CHECK_EQ(open("/ircc-test/hello", O_RDWR), -1);
+}
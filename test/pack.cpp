@@ -0,0 +1,88 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <ircc/ircc.h>
+#include <string>
+
+TEST_CASE("pack open")
+{
+    CHECK_EQ(ircc_pack_open("missing.ircpack"), -1);
+    CHECK_EQ(ircc_pack_open("helloworld.txt"), -1);
+    REQUIRE_EQ(ircc_pack_open(IRCC_TEST_PACK), 0);
+}
+
+TEST_CASE("pack c_string")
+{
+    size_t size;
+    const char *resource = ircc_c_string("another_key", &size);
+    REQUIRE_NE(resource, nullptr);
+    CHECK_EQ(size, 15);
+    CHECK_EQ(strcmp("HelloUnderWorld", resource), 0);
+    CHECK_EQ((uintptr_t)resource % 64, 0);
+    CHECK_EQ(ircc_c_string("zzz", &size), nullptr);
+}
+
+TEST_CASE("pack pair")
+{
+    auto [resource, size] = ircc_pair("/image");
+    CHECK_NE(resource, nullptr);
+    CHECK_EQ(size, 38905);
+    CHECK_EQ(ircc_string("/hello"), "HelloWorld");
+}
+
+TEST_CASE("pack keys")
+{
+    std::string dir = "long/";
+    for (int i = 0; i < 12; ++i)
+        dir += "d123456789/";
+    CHECK_EQ(ircc_keys(),
+             std::vector<std::string>{"/config",
+                                      "/hello",
+                                      "/image",
+                                      "/tar/gnu/" + dir + "data.txt",
+                                      "/tar/gnu/zlink.txt",
+                                      "/tar/nested/data.txt",
+                                      "/tar/pax/" + dir + "data.txt",
+                                      "/tar/pax/zlink.txt",
+                                      "/tar/readme.txt",
+                                      "/tar/ustar/a.txt",
+                                      "/tar/ustar/" + dir + "b.txt",
+                                      "/web/functions.json",
+                                      "/web/index.html",
+                                      "another_key"});
+    CHECK_EQ(ircc_name_by_no(14), nullptr);
+}
+
+TEST_CASE("pack swap")
+{
+    const struct ircc_pack *view = ircc_pack_acquire();
+    REQUIRE_NE(view, nullptr);
+    size_t size;
+    const char *old_hello = ircc_pack_c_string(view, "/hello", &size);
+    REQUIRE_NE(old_hello, nullptr);
+
+    REQUIRE_EQ(ircc_pack_open(IRCC_TEST_PACK), 0);
+    const struct ircc_pack *new_view = ircc_pack_acquire();
+    CHECK_NE(new_view, view);
+    CHECK_EQ(std::string(old_hello, size), "HelloWorld");
+    ircc_pack_release(new_view);
+    ircc_pack_release(view);
+
+    // plain accessors keep the pinned pack until a quiescent point
+    const char *pinned = ircc_c_string("/hello", NULL);
+    REQUIRE_EQ(ircc_pack_open(IRCC_TEST_PACK), 0);
+    CHECK_EQ(ircc_c_string("/hello", NULL), pinned);
+    ircc_pack_quiescent();
+    CHECK_NE(ircc_c_string("/hello", NULL), pinned);
+    CHECK_EQ(ircc_string("/hello"), "HelloWorld");
+}
+
+TEST_CASE("pack module")
+{
+    CHECK_EQ(ircc_pack_open_module("missing.so"), -1);
+    REQUIRE_EQ(ircc_pack_open_module(IRCC_TEST_MODULE), 0);
+    ircc_pack_quiescent();
+    CHECK_EQ(ircc_string("another_key"), "HelloUnderWorld");
+    CHECK_EQ(ircc_keys().size(), 14);
+    CHECK_EQ(ircc_name_by_no(14), nullptr);
+}